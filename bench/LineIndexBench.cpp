@@ -0,0 +1,97 @@
+// Measures how the line index build scales with the number of threads.
+//
+// Build it with, all on one line:
+//
+//   g++ -std=c++17 -O2 -Isrc bench/LineIndexBench.cpp src/PieceTable.cpp
+//       src/CompactText.cpp src/MappedFile.cpp src/ThreadPool.cpp
+//       src/Utf8Codec.cpp
+//       -o lineindexbench -lsfml-system -pthread
+//
+// and run it as:
+//
+//   ./lineindexbench [sizeInMiB] [path]
+//
+// A synthetic file of the requested size (1024 MiB by default) is written
+// once, then loaded with 1, 2, 4, ... threads up to the hardware count.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "MappedFile.h"
+#include "PieceTable.h"
+#include "ThreadPool.h"
+
+static bool writeSyntheticFile(const std::string &path, long long sizeMiB) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        return false;
+    }
+    const char *lines[] = {
+        "2024-05-01 12:00:00.000 INFO  request handled in 12ms path=/api/items\n",
+        "2024-05-01 12:00:00.001 DEBUG cache miss key=user:1234 shard=7\n",
+        "    at com.example.Service.handle(Service.java:42)\n",
+        "\tdetalle: operación completada — 日本語のログ\n",
+        "\n",
+    };
+    std::string block;
+    while (block.size() < (1 << 20)) {
+        block += lines[block.size() % 5];
+    }
+    long long target = sizeMiB << 20;
+    for (long long written = 0; written < target; written += block.size()) {
+        out.write(block.data(), block.size());
+    }
+    return (bool)out;
+}
+
+int main(int argc, char *argv[]) {
+    long long sizeMiB = argc > 1 ? std::stoll(argv[1]) : 1024;
+    std::string path = argc > 2 ? argv[2] : "lineindexbench.txt";
+
+    if (!writeSyntheticFile(path, sizeMiB)) {
+        std::cerr << "Can't write " << path << std::endl;
+        return 1;
+    }
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path)) {
+        std::cerr << "Can't map " << path << std::endl;
+        return 1;
+    }
+
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    double singleThreadSeconds = 0;
+    std::printf("%8s %10s %12s %8s %12s\n", "threads", "seconds", "MiB/s", "speedup", "lines");
+
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        ThreadPool pool(threads);
+        double best = 1e9;
+        int lines = 0;
+        for (int run = 0; run < 3; run++) {
+            PieceTable table;
+            auto start = std::chrono::steady_clock::now();
+            table.load(file, pool);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+            lines = table.lineCount();
+        }
+        if (threads == 1) {
+            singleThreadSeconds = best;
+        }
+        std::printf("%8d %10.3f %12.0f %7.2fx %12d\n", threads, best,
+            file->size() / (1024.0 * 1024.0) / best, singleThreadSeconds / best, lines);
+
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    file->close();
+    std::remove(path.c_str());
+    return 0;
+}
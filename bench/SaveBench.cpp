@@ -0,0 +1,107 @@
+// Compares saving a document with writing the same bytes straight to disk.
+//
+// Build it with, all on one line:
+//
+//   g++ -std=c++17 -O2 -Isrc bench/SaveBench.cpp src/TextDocument.cpp
+//       src/PieceTable.cpp src/CompactText.cpp src/UndoHistory.cpp
+//       src/AtomicFileWriter.cpp src/MappedFile.cpp src/ThreadPool.cpp
+//       src/Utf8Codec.cpp src/SpecialChars.cpp src/ColumnWidth.cpp
+//       src/DocumentMetrics.cpp src/DocumentSnapshot.cpp src/EditJournal.cpp
+//       src/MarkSet.cpp
+//       -o savebench -lsfml-system -pthread
+//
+// and run it as:
+//
+//   ./savebench [sizeInMiB] [path]
+//
+// A synthetic file of the requested size (512 MiB by default) is opened and
+// edited in a few places, then saved. The baseline writes the original bytes
+// through the same temp file + fsync + rename path, so the difference between
+// both is what encoding costs.
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "AtomicFileWriter.h"
+#include "MappedFile.h"
+#include "TextDocument.h"
+
+static bool writeSyntheticFile(const std::string &path, long long sizeMiB) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        return false;
+    }
+    const char *lines[] = {
+        "2024-05-01 12:00:00.000 INFO  request handled in 12ms path=/api/items\n",
+        "2024-05-01 12:00:00.001 DEBUG cache miss key=user:1234 shard=7\n",
+        "    at com.example.Service.handle(Service.java:42)\n",
+        "\tdetalle: operación completada — 日本語のログ\n",
+        "\n",
+    };
+    std::string block;
+    while (block.size() < (1 << 20)) {
+        block += lines[block.size() % 5];
+    }
+    long long target = sizeMiB << 20;
+    for (long long written = 0; written < target; written += block.size()) {
+        out.write(block.data(), block.size());
+    }
+    return (bool)out;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char *argv[]) {
+    long long sizeMiB = argc > 1 ? std::stoll(argv[1]) : 512;
+    std::string path = argc > 2 ? argv[2] : "savebench.txt";
+    std::string outputPath = path + ".out";
+
+    if (!writeSyntheticFile(path, sizeMiB)) {
+        std::cerr << "Can't write " << path << std::endl;
+        return 1;
+    }
+
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Can't map " << path << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    AtomicFileWriter raw;
+    if (!raw.open(outputPath) || !raw.write(file.data(), file.size()) || !raw.commit()) {
+        std::cerr << "Can't write " << outputPath << std::endl;
+        return 1;
+    }
+    double rawSeconds = secondsSince(start);
+    file.close();
+
+    TextDocument document;
+    if (!document.init(path)) {
+        return 1;
+    }
+    for (int i = 0; i < 100; i++) {
+        int line = (long long)document.getLineCount() * i / 100;
+        document.addTextToPos("edición ✓\n", line, 0);
+    }
+
+    start = std::chrono::steady_clock::now();
+    if (!document.saveFile(outputPath)) {
+        return 1;
+    }
+    double saveSeconds = secondsSince(start);
+
+    double mebibytes = sizeMiB;
+    std::printf("%-12s %10s %12s\n", "", "seconds", "MiB/s");
+    std::printf("%-12s %10.3f %12.0f\n", "raw write", rawSeconds, mebibytes / rawSeconds);
+    std::printf("%-12s %10.3f %12.0f\n", "saveFile", saveSeconds, mebibytes / saveSeconds);
+
+    std::remove(path.c_str());
+    std::remove(outputPath.c_str());
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include "AtomicFileWriter.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+// A snapshot taken before the document stopped reading from the target's
+// mapping may still hold it for a moment, which makes replacing it fail.
+constexpr int REPLACE_ATTEMPTS = 20;
+constexpr int REPLACE_RETRY_MS = 50;
+
+AtomicFileWriter::AtomicFileWriter() : fileHandle(nullptr) {}
+
+bool AtomicFileWriter::open(const std::string &filename) {
+    this->discard();
+
+    this->filename = filename;
+    this->tempFilename = filename + ".saving";
+    HANDLE file = CreateFileA(this->tempFilename.c_str(), GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    this->fileHandle = file;
+    return true;
+}
+
+bool AtomicFileWriter::write(const char *data, std::size_t size) {
+    while (size > 0) {
+        DWORD toWrite = size < (1u << 30) ? (DWORD)size : (1u << 30);
+        DWORD written;
+        if (!WriteFile(this->fileHandle, data, toWrite, &written, nullptr)) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool AtomicFileWriter::commit() {
+    bool flushed = FlushFileBuffers(this->fileHandle);
+    CloseHandle(this->fileHandle);
+    this->fileHandle = nullptr;
+
+    bool replaced = false;
+    for (int attempt = 0; flushed && !replaced && attempt < REPLACE_ATTEMPTS; attempt++) {
+        if (attempt > 0) {
+            DWORD error = GetLastError();
+            if (error != ERROR_ACCESS_DENIED && error != ERROR_SHARING_VIOLATION && error != ERROR_USER_MAPPED_FILE) {
+                break;
+            }
+            Sleep(REPLACE_RETRY_MS);
+        }
+        replaced = MoveFileExA(this->tempFilename.c_str(), this->filename.c_str(),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    }
+    if (!replaced) {
+        std::remove(this->tempFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+void AtomicFileWriter::discard() {
+    if (this->fileHandle) {
+        CloseHandle(this->fileHandle);
+        this->fileHandle = nullptr;
+        std::remove(this->tempFilename.c_str());
+    }
+}
+
+bool AtomicFileWriter::isOpen() const {
+    return this->fileHandle != nullptr;
+}
+
+#else
+
+AtomicFileWriter::AtomicFileWriter() : fd(-1) {}
+
+bool AtomicFileWriter::open(const std::string &filename) {
+    this->discard();
+
+    this->filename = filename;
+    this->tempFilename = filename + ".saving";
+    this->fd = ::open(this->tempFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (this->fd < 0) {
+        return false;
+    }
+
+    // The new file takes the place of the old one, permissions included.
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) == 0) {
+        fchmod(this->fd, fileStat.st_mode & 07777);
+    }
+    return true;
+}
+
+bool AtomicFileWriter::write(const char *data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(this->fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool AtomicFileWriter::commit() {
+    bool flushed = fsync(this->fd) == 0;
+    flushed = ::close(this->fd) == 0 && flushed;
+    this->fd = -1;
+
+    if (!flushed || rename(this->tempFilename.c_str(), this->filename.c_str()) != 0) {
+        std::remove(this->tempFilename.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable.
+    std::string::size_type slash = this->filename.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : this->filename.substr(0, slash + 1);
+    int directoryFd = ::open(directory.c_str(), O_RDONLY);
+    if (directoryFd >= 0) {
+        fsync(directoryFd);
+        ::close(directoryFd);
+    }
+    return true;
+}
+
+void AtomicFileWriter::discard() {
+    if (this->fd >= 0) {
+        ::close(this->fd);
+        this->fd = -1;
+        std::remove(this->tempFilename.c_str());
+    }
+}
+
+bool AtomicFileWriter::isOpen() const {
+    return this->fd >= 0;
+}
+
+#endif
+
+AtomicFileWriter::~AtomicFileWriter() {
+    this->discard();
+}
+
+const std::string &AtomicFileWriter::getTempFilename() const {
+    return this->tempFilename;
+}
@@ -0,0 +1,39 @@
+#ifndef AtomicFileWriter_H
+#define AtomicFileWriter_H
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Writes a file through a temporary sibling that only replaces the target
+// once all of it is on disk, so an interrupted save leaves the original file
+// untouched. Anything not committed is discarded on destruction.
+class AtomicFileWriter {
+   public:
+    AtomicFileWriter();
+    ~AtomicFileWriter();
+
+    AtomicFileWriter(const AtomicFileWriter &) = delete;
+    AtomicFileWriter &operator=(const AtomicFileWriter &) = delete;
+
+    bool open(const std::string &filename);
+    bool write(const char *data, std::size_t size);
+    // Flushes the temporary file to disk and renames it over the target.
+    bool commit();
+    void discard();
+
+    bool isOpen() const;
+    const std::string &getTempFilename() const;
+
+   private:
+    std::string filename;
+    std::string tempFilename;
+
+#ifdef _WIN32
+    void *fileHandle;
+#else
+    int fd;
+#endif
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef ColumnWidth_H
+#define ColumnWidth_H
+
+#include <SFML/Graphics.hpp>
+
+// Columns each character takes on the editor's grid: tabs take the tab
+// width, East Asian wide and fullwidth characters and emoji take 2,
+// combining marks and other zero-width characters take 0.
+namespace ColumnWidth {
+
+const int DEFAULT_TAB_WIDTH = 4;
+
+// Width of a character outside ASCII, from a table built at compile time.
+int unicodeWidth(sf::Uint32 c);
+
+inline int of(sf::Uint32 c, int tabWidth) {
+    if (c < 0x80) {
+        return c == '\t' ? tabWidth : 1;
+    }
+    return unicodeWidth(c);
+}
+
+}  // namespace ColumnWidth
+
+#endif
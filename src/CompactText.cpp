@@ -0,0 +1,150 @@
+#include "CompactText.h"
+
+#include <algorithm>
+
+#include "Utf8Codec.h"
+
+CompactText::CompactText() : width(1) {}
+
+int CompactText::size() const {
+    switch (this->width) {
+        case 1:
+            return this->narrow.size();
+        case 2:
+            return this->bmp.size();
+        default:
+            return this->wide.size();
+    }
+}
+
+bool CompactText::empty() const {
+    return this->size() == 0;
+}
+
+int CompactText::getWidth() const {
+    return this->width;
+}
+
+std::size_t CompactText::byteSize() const {
+    return (std::size_t)this->size() * this->width;
+}
+
+std::uint32_t CompactText::at(int index) const {
+    switch (this->width) {
+        case 1:
+            return this->narrow[index];
+        case 2:
+            return this->bmp[index];
+        default:
+            return this->wide[index];
+    }
+}
+
+void CompactText::reserve(int width, int capacity) {
+    this->width = width;
+    switch (width) {
+        case 1:
+            this->narrow.reserve(capacity);
+            break;
+        case 2:
+            this->bmp.reserve(capacity);
+            break;
+        default:
+            this->wide.reserve(capacity);
+    }
+}
+
+void CompactText::append(const std::uint32_t *data, int count) {
+    std::uint32_t widest = 0;
+    for (int i = 0; i < count; i++) {
+        widest = std::max(widest, data[i]);
+    }
+    if (widthFor(widest) > this->width) {
+        this->upgrade(widthFor(widest));
+    }
+
+    switch (this->width) {
+        case 1:
+            this->narrow.insert(this->narrow.end(), data, data + count);
+            break;
+        case 2:
+            this->bmp.insert(this->bmp.end(), data, data + count);
+            break;
+        default:
+            this->wide.append(data, count);
+    }
+}
+
+void CompactText::appendTo(Utf32Buffer &out, int start, int count) const {
+    switch (this->width) {
+        case 1:
+            out.append(this->narrow.begin() + start, this->narrow.begin() + start + count);
+            break;
+        case 2:
+            out.append(this->bmp.begin() + start, this->bmp.begin() + start + count);
+            break;
+        default:
+            out.append(this->wide, start, count);
+    }
+}
+
+void CompactText::copyTo(std::uint32_t *out, int start, int count) const {
+    switch (this->width) {
+        case 1:
+            std::copy(this->narrow.begin() + start, this->narrow.begin() + start + count, out);
+            break;
+        case 2:
+            std::copy(this->bmp.begin() + start, this->bmp.begin() + start + count, out);
+            break;
+        default:
+            std::copy(this->wide.begin() + start, this->wide.begin() + start + count, out);
+    }
+}
+
+const std::uint32_t *CompactText::wideData() const {
+    return this->width == 4 ? this->wide.data() : nullptr;
+}
+
+void CompactText::assignUtf8(const char *bytes, int size, int width, std::vector<int> &lineBreaks) {
+    this->release();
+    this->width = width;
+    switch (width) {
+        case 1:
+            Utf8Codec::decode(bytes, size, this->narrow, lineBreaks);
+            break;
+        case 2:
+            Utf8Codec::decode(bytes, size, this->bmp, lineBreaks);
+            break;
+        default:
+            Utf8Codec::decode(bytes, size, this->wide, lineBreaks);
+    }
+}
+
+void CompactText::release() {
+    std::vector<std::uint8_t>().swap(this->narrow);
+    std::vector<std::uint16_t>().swap(this->bmp);
+    Utf32Buffer().swap(this->wide);
+    this->width = 1;
+}
+
+int CompactText::widthFor(std::uint32_t codePoint) {
+    if (codePoint <= 0xFF) {
+        return 1;
+    }
+    return codePoint <= 0xFFFF ? 2 : 4;
+}
+
+void CompactText::upgrade(int newWidth) {
+    if (newWidth == 2) {
+        this->bmp.assign(this->narrow.begin(), this->narrow.end());
+    } else if (this->width == 1) {
+        this->wide.assign(this->narrow.begin(), this->narrow.end());
+    } else {
+        this->wide.assign(this->bmp.begin(), this->bmp.end());
+    }
+    std::vector<std::uint8_t>().swap(this->narrow);
+    if (newWidth == 4) {
+        std::vector<std::uint16_t>().swap(this->bmp);
+    }
+    this->width = newWidth;
+}
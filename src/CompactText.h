@@ -0,0 +1,52 @@
+#ifndef CompactText_H
+#define CompactText_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sequence of code points stored in the narrowest unit that fits all of them:
+// one byte up to U+00FF, two bytes up to U+FFFF, four bytes otherwise.
+// Appending a wider character upgrades the whole sequence.
+class CompactText {
+   public:
+    typedef std::basic_string<std::uint32_t> Utf32Buffer;
+
+    CompactText();
+
+    int size() const;
+    bool empty() const;
+    int getWidth() const;
+    std::size_t byteSize() const;
+
+    std::uint32_t at(int index) const;
+
+    // Sets the width of an empty text and makes room for `capacity` code
+    // points, so appending that many that fit the width never moves the ones
+    // already there.
+    void reserve(int width, int capacity);
+    void append(const std::uint32_t *data, int count);
+    void appendTo(Utf32Buffer &out, int start, int count) const;
+    // Copies `count` code points starting at `start` into `out`.
+    void copyTo(std::uint32_t *out, int start, int count) const;
+    // Pointer to the code points when they are stored four bytes wide.
+    const std::uint32_t *wideData() const;
+
+    // Replaces the contents with `size` UTF-8 bytes decoded at `width`, which
+    // must be wide enough for every code point in them.
+    void assignUtf8(const char *bytes, int size, int width, std::vector<int> &lineBreaks);
+
+    void release();
+
+    static int widthFor(std::uint32_t codePoint);
+
+   private:
+    int width;
+    std::vector<std::uint8_t> narrow;
+    std::vector<std::uint16_t> bmp;
+    Utf32Buffer wide;
+
+    void upgrade(int newWidth);
+};
+
+#endif
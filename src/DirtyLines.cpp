@@ -0,0 +1,43 @@
+#include "DirtyLines.h"
+
+#include <algorithm>
+
+void DirtyLines::add(int firstLine, int lastLine) {
+    if (lastLine < firstLine) {
+        return;
+    }
+
+    // First range that doesn't end before the new one starts (touching
+    // ranges merge too).
+    auto it = std::lower_bound(this->ranges.begin(), this->ranges.end(), firstLine,
+        [](const std::pair<int, int> &range, int line) { return range.second < line - 1; });
+
+    auto last = it;
+    while (last != this->ranges.end() && last->first <= lastLine + 1LL) {
+        firstLine = std::min(firstLine, last->first);
+        lastLine = std::max(lastLine, last->second);
+        ++last;
+    }
+
+    it = this->ranges.erase(it, last);
+    this->ranges.insert(it, std::make_pair(firstLine, lastLine));
+}
+
+void DirtyLines::addAll() {
+    this->ranges.clear();
+    this->add(0, TO_END);
+}
+
+bool DirtyLines::intersects(int firstLine, int lastLine) const {
+    auto it = std::lower_bound(this->ranges.begin(), this->ranges.end(), firstLine,
+        [](const std::pair<int, int> &range, int line) { return range.second < line; });
+    return it != this->ranges.end() && it->first <= lastLine;
+}
+
+bool DirtyLines::isEmpty() const {
+    return this->ranges.empty();
+}
+
+void DirtyLines::clear() {
+    this->ranges.clear();
+}
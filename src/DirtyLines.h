@@ -0,0 +1,25 @@
+#ifndef DirtyLines_H
+#define DirtyLines_H
+
+#include <climits>
+#include <utility>
+#include <vector>
+
+// Set of line ranges whose rendering went stale, kept sorted and merged.
+class DirtyLines {
+   public:
+    // lastLine value for "this line and every line below it", used when an
+    // edit adds or removes line breaks and the lines after it move.
+    static const int TO_END = INT_MAX;
+
+    void add(int firstLine, int lastLine);
+    void addAll();
+    bool intersects(int firstLine, int lastLine) const;
+    bool isEmpty() const;
+    void clear();
+
+   private:
+    std::vector<std::pair<int, int>> ranges;
+};
+
+#endif
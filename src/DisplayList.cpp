@@ -0,0 +1,11 @@
+#include "DisplayList.h"
+
+TileContent::TileContent()
+    : row(0), column(0), generation(0), background(sf::Triangles), text(sf::Triangles),
+      ownBackgroundCount(0), ownTextCount(0) {}
+
+MinimapBlock::MinimapBlock() : index(0), generation(0) {}
+
+DisplayList::DisplayList()
+    : cursor(sf::Triangles), minimapBackground(sf::Triangles), minimapViewport(sf::Triangles),
+      textTexture(nullptr), lineNumberTexture(nullptr), fontMutex(nullptr) {}
@@ -0,0 +1,67 @@
+#ifndef DisplayList_H
+#define DisplayList_H
+
+#include <SFML/Graphics.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Background and text of one tile of the document, in document coordinates.
+// Never changed once built, so the render thread can raster it while the UI
+// thread goes on building newer ones.
+struct TileContent {
+    TileContent();
+
+    int row;
+    int column;
+    sf::FloatRect bounds;
+    // Different for every tile content ever built, so the render thread
+    // knows when what it has rastered went stale.
+    unsigned long long generation;
+    // The tile's own lines come first, followed by the lines just above and
+    // below it, whose descenders and selections reach into the tile.
+    sf::VertexArray background;
+    sf::VertexArray text;
+    std::size_t ownBackgroundCount;
+    std::size_t ownTextCount;
+};
+
+// Minimap image of lines index * Minimap::BLOCK_LINES on, drawn on a worker
+// thread and never changed afterwards.
+struct MinimapBlock {
+    MinimapBlock();
+
+    int index;
+    // Different for every block image ever drawn, like TileContent's.
+    unsigned long long generation;
+    sf::Image image;
+};
+
+// Everything one frame shows. EditorView builds it on the UI thread and
+// EditorRenderer draws it on the render thread.
+struct DisplayList {
+    DisplayList();
+
+    sf::View camera;
+    sf::Vector2i tileSize;
+    std::vector<std::shared_ptr<const TileContent>> tiles;
+    std::shared_ptr<const sf::VertexArray> margin;
+    std::shared_ptr<const sf::VertexArray> lineNumbers;
+    sf::VertexArray cursor;
+
+    // minimapView maps minimap pixels to the minimap panel of the window.
+    // Blocks go between the panel background and the outline of what the
+    // camera shows.
+    sf::View minimapView;
+    sf::VertexArray minimapBackground;
+    std::vector<std::shared_ptr<const MinimapBlock>> minimapBlocks;
+    sf::VertexArray minimapViewport;
+
+    // Font textures glyphs were taken from. The font changes them when it
+    // loads new glyphs, so they are only used with fontMutex held.
+    const sf::Texture *textTexture;
+    const sf::Texture *lineNumberTexture;
+    std::mutex *fontMutex;
+};
+
+#endif
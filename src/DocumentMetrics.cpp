@@ -0,0 +1,243 @@
+#include "DocumentMetrics.h"
+
+#include <algorithm>
+
+#include "ColumnWidth.h"
+
+namespace {
+
+// Invalid code points are saved as U+FFFD, which also takes 3 bytes.
+int utf8BytesOf(sf::Uint32 c) {
+    if (c < 0x80) {
+        return 1;
+    } else if (c < 0x800) {
+        return 2;
+    } else if (c < 0x10000 || c > 0x10FFFF) {
+        return 3;
+    }
+    return 4;
+}
+
+PieceTable::Offset lineEnd(const PieceTable &text, int line) {
+    return line + 1 < text.lineCount() ? text.lineStart(line + 1) - 1 : text.length();
+}
+
+}  // namespace
+
+DocumentMetrics::LineMetrics DocumentMetrics::LineMetrics::operator+(const LineMetrics &other) const {
+    return {this->width + other.width, this->bytes + other.bytes};
+}
+
+DocumentMetrics::LineMetrics DocumentMetrics::LineMetrics::operator-(const LineMetrics &other) const {
+    return {this->width - other.width, this->bytes - other.bytes};
+}
+
+DocumentMetrics::Totals::Totals() : lineBytes(0) {}
+
+void DocumentMetrics::Totals::add(const Totals &other) {
+    for (const auto &entry : other.lineWidths) {
+        long long &count = this->lineWidths[entry.first];
+        count += entry.second;
+        if (count == 0) {
+            this->lineWidths.erase(entry.first);
+        }
+    }
+    this->lineBytes += other.lineBytes;
+}
+
+void DocumentMetrics::Totals::count(const LineMetrics &line, int sign) {
+    long long &count = this->lineWidths[line.width];
+    count += sign;
+    if (count == 0) {
+        this->lineWidths.erase(line.width);
+    }
+    this->lineBytes += sign * line.bytes;
+}
+
+DocumentMetrics::DocumentMetrics() : tabWidth(ColumnWidth::DEFAULT_TAB_WIDTH), pending({0, 0}) {}
+
+void DocumentMetrics::reset(PieceTable &text, int tabWidth) {
+    this->tabWidth = tabWidth;
+    this->totals = Totals();
+    this->measuring = std::future<Totals>();
+    this->recentLines.clear();
+    if (text.length() < BACKGROUND_MEASURE_CHARS) {
+        measure(text, 0, text.lineCount() - 1, tabWidth, this->totals, 1);
+        return;
+    }
+
+    auto snapshot = std::make_shared<PieceTable>(text.snapshot());
+    auto measured = std::make_shared<std::promise<Totals>>();
+    this->measuring = measured->get_future();
+    ThreadPool::shared().submit([snapshot, measured, tabWidth]() {
+        Totals totals;
+        measure(*snapshot, 0, snapshot->lineCount() - 1, tabWidth, totals, 1);
+        measured->set_value(std::move(totals));
+    });
+}
+
+// Takes away the lines the change replaces. An erase measures the characters
+// it takes and works out what is left of its first and last lines from them.
+void DocumentMetrics::beforeChange(const PieceTable &text, bool insertion, PieceTable::Offset pos,
+    PieceTable::Offset amount) {
+    int firstLine = text.lineOf(pos);
+    LineMetrics first = this->lineMetrics(text, firstLine);
+    this->totals.count(first, -1);
+    if (insertion) {
+        this->pending = first;
+        return;
+    }
+
+    amount = std::min(amount, text.length() - pos);
+    int lastLine = text.lineOf(pos + amount);
+    if (lastLine == firstLine) {
+        this->pending = first - measureRun(text, pos, amount, this->tabWidth, nullptr);
+        return;
+    }
+    LineMetrics last = this->lineMetrics(text, lastLine);
+    this->totals.count(last, -1);
+    LineMetrics erasedHead = {0, 0};
+    bool inFirstLine = true;
+    LineMetrics erasedTail = measureRun(text, pos, amount, this->tabWidth, [&](const LineMetrics &line) {
+        if (inFirstLine) {
+            erasedHead = line;
+            inFirstLine = false;
+        } else {
+            this->totals.count(line, -1);
+        }
+    });
+    this->pending = (first - erasedHead) + (last - erasedTail);
+    this->forgetLines(firstLine, lastLine, firstLine - lastLine);
+}
+
+// Adds the lines the change leaves. An insertion that splits its line
+// measures the shorter side of the split; the other side is what is left.
+void DocumentMetrics::afterChange(const PieceTable &text, bool insertion, PieceTable::Offset pos,
+    PieceTable::Offset amount) {
+    int firstLine = text.lineOf(pos);
+    if (!insertion) {
+        this->totals.count(this->pending, 1);
+        this->remember(firstLine, this->pending);
+        return;
+    }
+
+    int lastLine = text.lineOf(pos + amount);
+    this->forgetLines(firstLine, firstLine, lastLine - firstLine);
+    if (lastLine == firstLine) {
+        LineMetrics line = this->pending + measureRun(text, pos, amount, this->tabWidth, nullptr);
+        this->totals.count(line, 1);
+        this->remember(firstLine, line);
+        return;
+    }
+
+    PieceTable::Offset lineStart = text.lineStart(firstLine);
+    PieceTable::Offset suffixStart = pos + amount;
+    PieceTable::Offset suffixLength = lineEnd(text, lastLine) - suffixStart;
+    LineMetrics prefix, suffix;
+    if (pos - lineStart <= suffixLength) {
+        prefix = measureRun(text, lineStart, pos - lineStart, this->tabWidth, nullptr);
+        suffix = this->pending - prefix;
+    } else {
+        suffix = measureRun(text, suffixStart, suffixLength, this->tabWidth, nullptr);
+        prefix = this->pending - suffix;
+    }
+
+    LineMetrics first = prefix;
+    bool inFirstLine = true;
+    LineMetrics last = suffix + measureRun(text, pos, amount, this->tabWidth, [&](const LineMetrics &line) {
+        if (inFirstLine) {
+            first = first + line;
+            inFirstLine = false;
+            this->totals.count(first, 1);
+        } else {
+            this->totals.count(line, 1);
+        }
+    });
+    this->totals.count(last, 1);
+    this->remember(firstLine, first);
+    this->remember(lastLine, last);
+}
+
+int DocumentMetrics::getLongestLineWidth() {
+    this->collectMeasured();
+    for (auto it = this->totals.lineWidths.rbegin(); it != this->totals.lineWidths.rend(); ++it) {
+        if (it->second > 0) {
+            return it->first;
+        }
+    }
+    return 0;
+}
+
+long long DocumentMetrics::getLineBytes() {
+    this->collectMeasured();
+    return this->totals.lineBytes;
+}
+
+void DocumentMetrics::collectMeasured() {
+    if (this->measuring.valid() &&
+        this->measuring.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        this->totals.add(this->measuring.get());
+    }
+}
+
+DocumentMetrics::LineMetrics DocumentMetrics::lineMetrics(const PieceTable &text, int line) const {
+    for (const RecentLine &recent : this->recentLines) {
+        if (recent.line == line) {
+            return recent.metrics;
+        }
+    }
+    PieceTable::Offset start = text.lineStart(line);
+    return measureRun(text, start, lineEnd(text, line) - start, this->tabWidth, nullptr);
+}
+
+void DocumentMetrics::remember(int line, const LineMetrics &metrics) {
+    this->forgetLines(line, line, 0);
+    this->recentLines.insert(this->recentLines.begin(), {line, metrics});
+    if (this->recentLines.size() > (std::size_t)RECENT_LINES) {
+        this->recentLines.pop_back();
+    }
+}
+
+// Drops lines firstLine to lastLine and moves the ones after them by `shift`.
+void DocumentMetrics::forgetLines(int firstLine, int lastLine, int shift) {
+    for (auto it = this->recentLines.begin(); it != this->recentLines.end();) {
+        if (it->line > lastLine) {
+            it->line += shift;
+        } else if (it->line >= firstLine) {
+            it = this->recentLines.erase(it);
+            continue;
+        }
+        ++it;
+    }
+}
+
+// Adds (sign 1) or takes away (sign -1) lines firstLine to lastLine.
+void DocumentMetrics::measure(const PieceTable &text, int firstLine, int lastLine, int tabWidth, Totals &into,
+    int sign) {
+    PieceTable::Offset start = text.lineStart(firstLine);
+    LineMetrics last = measureRun(text, start, lineEnd(text, lastLine) - start, tabWidth,
+        [&](const LineMetrics &line) { into.count(line, sign); });
+    into.count(last, sign);
+}
+
+// Measures `amount` characters from `pos`, handing each part ended by a line
+// break to `lineDone` and returning the part after the last one.
+DocumentMetrics::LineMetrics DocumentMetrics::measureRun(const PieceTable &text, PieceTable::Offset pos,
+    PieceTable::Offset amount, int tabWidth, const std::function<void(const LineMetrics &)> &lineDone) {
+    LineMetrics line = {0, 0};
+    if (amount <= 0) {
+        return line;
+    }
+    text.forEachRun(pos, amount, [&](const sf::Uint32 *data, int size) {
+        for (int i = 0; i < size; i++) {
+            if (PieceTable::isLineBreak(data[i])) {
+                lineDone(line);
+                line = {0, 0};
+            } else {
+                line.width += ColumnWidth::of(data[i], tabWidth);
+                line.bytes += utf8BytesOf(data[i]);
+            }
+        }
+    });
+    return line;
+}
@@ -0,0 +1,85 @@
+#ifndef DocumentMetrics_H
+#define DocumentMetrics_H
+
+#include <functional>
+#include <future>
+#include <map>
+#include <vector>
+
+#include "PieceTable.h"
+
+// UTF-8 size and widest line of a document, kept up to date on every edit so
+// reading them costs O(1). Widths and sizes add up character by character,
+// so an edit to a line measured lately only measures the characters it
+// inserts or erases; the widths of all lines are kept as a histogram, so the
+// widest line is still known after it gets shorter or goes away.
+class DocumentMetrics {
+   public:
+    DocumentMetrics();
+
+    // Measures every line of `text`, with tabs tabWidth columns wide. Large
+    // documents are measured on the shared thread pool from a snapshot;
+    // until that finishes only the lines edited since count.
+    void reset(PieceTable &text, int tabWidth);
+
+    // Called right before and right after `text` gets an insertion (true) or
+    // an erase (false) of `amount` characters at `pos`.
+    void beforeChange(const PieceTable &text, bool insertion, PieceTable::Offset pos, PieceTable::Offset amount);
+    void afterChange(const PieceTable &text, bool insertion, PieceTable::Offset pos, PieceTable::Offset amount);
+
+    // Columns of the widest line.
+    int getLongestLineWidth();
+    // UTF-8 size of all lines, without the line breaks between them.
+    long long getLineBytes();
+
+    // Documents with fewer characters are measured on the calling thread.
+    static const int BACKGROUND_MEASURE_CHARS = 1 << 20;
+
+    // Lines whose width and size are kept to edit them cheaply.
+    static const int RECENT_LINES = 16;
+
+   private:
+    struct LineMetrics {
+        int width;
+        long long bytes;
+
+        LineMetrics operator+(const LineMetrics &other) const;
+        LineMetrics operator-(const LineMetrics &other) const;
+    };
+
+    struct RecentLine {
+        int line;
+        LineMetrics metrics;
+    };
+
+    struct Totals {
+        // Number of lines of each width. Counts go negative while a
+        // background measurement is missing.
+        std::map<int, long long> lineWidths;
+        // Bytes of every line, not counting the line breaks.
+        long long lineBytes;
+
+        Totals();
+        void add(const Totals &other);
+        void count(const LineMetrics &line, int sign);
+    };
+
+    Totals totals;
+    std::future<Totals> measuring;
+    int tabWidth;
+    // Most recently measured first.
+    std::vector<RecentLine> recentLines;
+    // Between beforeChange and afterChange: the line an insertion goes into,
+    // or what an erase leaves of the lines it joins.
+    LineMetrics pending;
+
+    void collectMeasured();
+    LineMetrics lineMetrics(const PieceTable &text, int line) const;
+    void remember(int line, const LineMetrics &metrics);
+    void forgetLines(int firstLine, int lastLine, int shift);
+    static void measure(const PieceTable &text, int firstLine, int lastLine, int tabWidth, Totals &into, int sign);
+    static LineMetrics measureRun(const PieceTable &text, PieceTable::Offset pos, PieceTable::Offset amount,
+        int tabWidth, const std::function<void(const LineMetrics &)> &lineDone);
+};
+
+#endif
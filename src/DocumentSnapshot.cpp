@@ -0,0 +1,78 @@
+#include "DocumentSnapshot.h"
+
+DocumentSnapshot::DocumentSnapshot(PieceTable text, unsigned long long version)
+    : text(std::move(text)), version(version) {}
+
+unsigned long long DocumentSnapshot::getVersion() const {
+    return this->version;
+}
+
+PieceTable::Offset DocumentSnapshot::length() const {
+    return this->text.length();
+}
+
+int DocumentSnapshot::getLineCount() const {
+    return this->text.lineCount();
+}
+
+int DocumentSnapshot::charsInLine(int line) const {
+    PieceTable::Offset lineStart = this->text.lineStart(line);
+
+    if (line == this->getLineCount() - 1) {
+        return this->text.length() - lineStart;
+    } else {
+        return this->text.lineStart(line + 1) - lineStart - 1;
+    }
+}
+
+sf::String DocumentSnapshot::getLine(int lineNumber) const {
+    int lastLine = this->getLineCount() - 1;
+
+    if (lineNumber < 0 || lineNumber > lastLine) {
+        std::cerr << "lineNumber " << lineNumber << " is not a valid number line. "
+                  << "Max is: " << lastLine << std::endl;
+        return "";
+    }
+
+    return this->text.substring(this->text.lineStart(lineNumber), this->charsInLine(lineNumber));
+}
+
+sf::String DocumentSnapshot::getTextFromPos(int amount, int line, int charN) const {
+    return this->text.substring(this->text.lineStart(line) + charN, amount);
+}
+
+// The document may still be reading from a mapping of `filename`, so the new
+// contents go to a sibling file that then replaces it. On POSIX the mapping
+// keeps the old file alive until it is closed; Windows won't replace a mapped
+// file, so there the document stops reading from it before saving.
+bool DocumentSnapshot::saveTo(const std::string &filename) const {
+    AtomicFileWriter outputFile;
+    if (!outputFile.open(filename)) {
+        std::cerr << "Error opening file: " << outputFile.getTempFilename() << std::endl;
+        return false;
+    }
+
+    // Small runs are gathered so the file gets few, large writes; big ones
+    // (mostly untouched text of the original file) are written as they are.
+    std::vector<char> pending;
+    pending.reserve(SAVE_BUFFER_BYTES);
+    bool written = true;
+    this->text.forEachUtf8Run([&](const char *run, std::size_t runLength) {
+        if (pending.size() + runLength > SAVE_BUFFER_BYTES) {
+            written = written && outputFile.write(pending.data(), pending.size());
+            pending.clear();
+        }
+        if (runLength >= SAVE_BUFFER_BYTES) {
+            written = written && outputFile.write(run, runLength);
+        } else {
+            pending.insert(pending.end(), run, run + runLength);
+        }
+    });
+    written = written && outputFile.write(pending.data(), pending.size());
+
+    if (!written || !outputFile.commit()) {
+        std::cerr << "Error saving file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef DocumentSnapshot_H
+#define DocumentSnapshot_H
+
+#include <SFML/Graphics.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AtomicFileWriter.h"
+#include "PieceTable.h"
+
+// Read-only view of a TextDocument as it was at one version. It shares the
+// document's storage instead of copying it, and every member can be called
+// from any thread while the document keeps changing.
+class DocumentSnapshot {
+   public:
+    DocumentSnapshot(PieceTable text, unsigned long long version);
+
+    unsigned long long getVersion() const;
+
+    PieceTable::Offset length() const;
+    int getLineCount() const;
+    int charsInLine(int line) const;
+    sf::String getLine(int lineNumber) const;
+    sf::String getTextFromPos(int amount, int line, int charN) const;
+
+    bool saveTo(const std::string &filename) const;
+
+    // Saving gathers runs of text smaller than this into writes of this size.
+    static const int SAVE_BUFFER_BYTES = 4 << 20;
+
+   private:
+    PieceTable text;
+    unsigned long long version;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include "EditJournal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[4] = {'T', 'E', 'J', '1'};
+// Magic, file size, file modification time and base version.
+const std::size_t HEADER_BYTES = 4 + 8 + 8 + 8;
+
+// Record kinds.
+const int ERASE = 0;
+const int INSERT = 1;
+const int MOVE = 2;
+
+void putFixed(std::string &out, std::uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out += (char)(value >> (8 * i));
+    }
+}
+
+std::uint64_t getFixed(const char *p) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (std::uint64_t)(unsigned char)p[i] << (8 * i);
+    }
+    return value;
+}
+
+void putVarint(std::vector<char> &out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool getVarint(const char *&p, const char *end, std::uint64_t &value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (std::uint64_t)(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint32_t checksum(const char *data, std::size_t size) {
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Each record is: version, kind, position and amount as varints, the
+// position moved to for moves, the inserted text, then a checksum of all of
+// it. Moves `p` past the record, or returns false if it is truncated or
+// corrupted.
+bool readRecord(const char *&p, const char *end, EditJournal::Edit &edit) {
+    const char *recordStart = p;
+    std::uint64_t version, kind, pos, amount, to = 0;
+    if (!getVarint(p, end, version) || !getVarint(p, end, kind) || !getVarint(p, end, pos)
+        || !getVarint(p, end, amount) || kind > MOVE || (kind == MOVE && !getVarint(p, end, to))) {
+        return false;
+    }
+    std::size_t textBytes = kind == INSERT ? amount : 0;
+    if ((std::size_t)(end - p) < textBytes + 4) {
+        return false;
+    }
+    const char *text = p;
+    p += textBytes;
+
+    std::uint32_t stored = 0;
+    for (int i = 0; i < 4; i++) {
+        stored |= (std::uint32_t)(unsigned char)p[i] << (8 * i);
+    }
+    if (stored != checksum(recordStart, p - recordStart)) {
+        return false;
+    }
+    p += 4;
+
+    edit.version = version;
+    edit.insertion = kind == INSERT;
+    edit.move = kind == MOVE;
+    edit.pos = pos;
+    edit.amount = edit.insertion ? 0 : amount;
+    edit.to = to;
+    edit.text.assign(text, textBytes);
+    return true;
+}
+
+void syncFile(std::FILE *file) {
+    std::fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+}  // namespace
+
+EditJournal::EditJournal() : file(nullptr), recording(false), stopping(false) {}
+
+EditJournal::~EditJournal() {
+    this->close(false);
+}
+
+std::string EditJournal::journalFilename(const std::string &filename) {
+    return filename + ".journal";
+}
+
+// The journal only applies to the exact file it was started against, which
+// is recognised by its size and modification time.
+std::string EditJournal::header(const std::string &filename, unsigned long long baseVersion) {
+    std::error_code error;
+    std::uint64_t size = std::filesystem::file_size(filename, error);
+    if (error) {
+        size = 0;
+    }
+    auto modified = std::filesystem::last_write_time(filename, error);
+    std::uint64_t time = error ? 0 : (std::uint64_t)modified.time_since_epoch().count();
+
+    std::string out(MAGIC, sizeof(MAGIC));
+    putFixed(out, size);
+    putFixed(out, time);
+    putFixed(out, baseVersion);
+    return out;
+}
+
+bool EditJournal::replay(const std::string &filename, const std::function<bool(const Edit &)> &apply,
+    unsigned long long &baseVersion, unsigned long long &lastVersion) {
+    std::string journal = journalFilename(filename);
+    std::ifstream input(journal, std::ios::binary);
+    if (!input.is_open()) {
+        return false;
+    }
+    std::stringstream contents;
+    contents << input.rdbuf();
+    input.close();
+
+    std::string bytes = contents.str();
+    std::string expected = header(filename, 0);
+    if (bytes.size() < HEADER_BYTES || bytes.compare(0, HEADER_BYTES - 8, expected, 0, HEADER_BYTES - 8) != 0) {
+        std::cerr << "Ignoring journal written for another version of " << filename << std::endl;
+        return false;
+    }
+    baseVersion = getFixed(bytes.data() + HEADER_BYTES - 8);
+    lastVersion = baseVersion;
+
+    const char *p = bytes.data() + HEADER_BYTES;
+    const char *end = bytes.data() + bytes.size();
+    const char *replayed = p;
+    Edit edit;
+    while (p < end && readRecord(p, end, edit)) {
+        if (!apply(edit)) {
+            std::cerr << "Journal of " << filename << " does not match the file, stopping replay" << std::endl;
+            break;
+        }
+        lastVersion = edit.version;
+        replayed = p;
+    }
+
+    // Whatever could not be replayed is cut off, so that new records appended
+    // to the journal follow the last good one.
+    std::size_t replayedBytes = replayed - bytes.data();
+    if (replayedBytes < bytes.size()) {
+        AtomicFileWriter output;
+        if (!output.open(journal) || !output.write(bytes.data(), replayedBytes) || !output.commit()) {
+            std::cerr << "Error rewriting journal: " << journal << std::endl;
+        }
+    }
+    return replayedBytes > HEADER_BYTES;
+}
+
+bool EditJournal::open(const std::string &filename, unsigned long long baseVersion, bool resume) {
+    this->close(false);
+    std::lock_guard<std::mutex> fileLock(this->fileMutex);
+    this->filename = filename;
+
+    std::string journal = journalFilename(filename);
+    if (resume) {
+        this->file = std::fopen(journal.c_str(), "ab");
+    } else {
+        this->file = std::fopen(journal.c_str(), "wb");
+        if (this->file) {
+            std::string start = header(filename, baseVersion);
+            std::fwrite(start.data(), 1, start.size(), this->file);
+            syncFile(this->file);
+        }
+    }
+    if (!this->file) {
+        std::cerr << "Error opening journal: " << journal << std::endl;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->recording = true;
+        this->stopping = false;
+    }
+    this->flusher = std::thread(&EditJournal::flushLoop, this);
+    return true;
+}
+
+void EditJournal::close(bool discard) {
+    if (this->flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->wake.notify_one();
+        this->flusher.join();
+    }
+
+    std::lock_guard<std::mutex> fileLock(this->fileMutex);
+    this->writePendingLocked();
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->recording = false;
+        this->pending.clear();
+    }
+    if (this->file) {
+        std::fclose(this->file);
+        this->file = nullptr;
+        if (discard) {
+            std::remove(journalFilename(this->filename).c_str());
+        }
+    }
+}
+
+bool EditJournal::isOpen() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->recording;
+}
+
+void EditJournal::recordInsert(unsigned long long version, long long pos, const sf::String &text) {
+    std::vector<char> encoded((std::size_t)text.getSize() * Utf8Codec::MAX_BYTES_PER_CHAR);
+    int bytes = Utf8Codec::encode(text.getData(), text.getSize(), encoded.data());
+    this->append(version, INSERT, pos, bytes, 0, encoded.data(), bytes);
+}
+
+void EditJournal::recordErase(unsigned long long version, long long pos, long long amount) {
+    this->append(version, ERASE, pos, amount, 0, nullptr, 0);
+}
+
+void EditJournal::recordMove(unsigned long long version, long long from, long long amount, long long to) {
+    this->append(version, MOVE, from, amount, to, nullptr, 0);
+}
+
+void EditJournal::append(unsigned long long version, int kind, long long pos, long long amount, long long to,
+    const char *text, std::size_t textBytes) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (!this->recording) {
+        return;
+    }
+    bool wasEmpty = this->pending.empty();
+    std::size_t recordStart = this->pending.size();
+    putVarint(this->pending, version);
+    putVarint(this->pending, kind);
+    putVarint(this->pending, pos);
+    putVarint(this->pending, amount);
+    if (kind == MOVE) {
+        putVarint(this->pending, to);
+    }
+    this->pending.insert(this->pending.end(), text, text + textBytes);
+
+    std::uint32_t sum = checksum(this->pending.data() + recordStart, this->pending.size() - recordStart);
+    for (int i = 0; i < 4; i++) {
+        this->pending.push_back((char)(sum >> (8 * i)));
+    }
+    lock.unlock();
+    if (wasEmpty) {
+        this->wake.notify_one();
+    }
+}
+
+void EditJournal::flush() {
+    this->writePending();
+}
+
+void EditJournal::writePending() {
+    std::lock_guard<std::mutex> fileLock(this->fileMutex);
+    this->writePendingLocked();
+}
+
+// Takes what is pending and writes it with only fileMutex held. While the
+// file is closed the records stay pending for the next write.
+void EditJournal::writePendingLocked() {
+    if (!this->file) {
+        return;
+    }
+    std::vector<char> records;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        records.swap(this->pending);
+    }
+    if (records.empty()) {
+        return;
+    }
+    std::fwrite(records.data(), 1, records.size(), this->file);
+    syncFile(this->file);
+}
+
+// Sleeps until there is something to write, then gives the edits that follow
+// the interval to join it before the sync. close() writes whatever is left.
+void EditJournal::flushLoop() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->wake.wait(lock, [this] { return this->stopping || !this->pending.empty(); });
+        if (this->stopping) {
+            return;
+        }
+        this->wake.wait_for(lock, std::chrono::milliseconds(+FLUSH_INTERVAL_MS), [this] { return this->stopping; });
+        lock.unlock();
+        this->writePending();
+        lock.lock();
+    }
+}
+
+// Reads and rewrites the journal with only fileMutex held, so edits go on
+// being recorded meanwhile; they stay pending and go to the new journal.
+bool EditJournal::rebase(const std::string &filename, unsigned long long savedVersion) {
+    std::lock_guard<std::mutex> fileLock(this->fileMutex);
+
+    std::string bytes;
+    if (this->file) {
+        this->writePendingLocked();
+        std::fclose(this->file);
+        this->file = nullptr;
+
+        std::ifstream input(journalFilename(this->filename), std::ios::binary);
+        std::stringstream contents;
+        contents << input.rdbuf();
+        bytes = contents.str();
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->recording = true;
+    }
+
+    // The edits past the saved version apply on top of the saved file,
+    // whatever its name. A torn record at the end is dropped here as it would
+    // be on replay.
+    std::string rebased = header(filename, savedVersion);
+    const char *p = bytes.data() + std::min(HEADER_BYTES, bytes.size());
+    const char *end = bytes.data() + bytes.size();
+    Edit edit;
+    while (p < end) {
+        const char *recordStart = p;
+        if (!readRecord(p, end, edit)) {
+            break;
+        }
+        if (edit.version > savedVersion) {
+            rebased.append(recordStart, p - recordStart);
+        }
+    }
+
+    std::string journal = journalFilename(filename);
+    AtomicFileWriter output;
+    bool written = output.open(journal) && output.write(rebased.data(), rebased.size()) && output.commit();
+    if (!this->filename.empty() && this->filename != filename) {
+        std::remove(journalFilename(this->filename).c_str());
+    }
+    this->filename = filename;
+    this->file = std::fopen(journal.c_str(), "ab");
+    if (!written || !this->file) {
+        std::cerr << "Error rewriting journal: " << journal << std::endl;
+        if (!this->file) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->recording = false;
+            this->pending.clear();
+        }
+        return false;
+    }
+
+    if (!this->flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = false;
+        }
+        this->flusher = std::thread(&EditJournal::flushLoop, this);
+    }
+    return true;
+}
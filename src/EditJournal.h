@@ -0,0 +1,101 @@
+#ifndef EditJournal_H
+#define EditJournal_H
+
+#include <SFML/Graphics.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AtomicFileWriter.h"
+#include "Utf8Codec.h"
+
+// Append-only log of the edits made to a file since it was last saved, kept
+// next to it as "<file>.journal". Edits are buffered in memory and written
+// and synced by a background thread FLUSH_INTERVAL_MS after the first of them,
+// so recording one costs no I/O; with nothing to write the thread sleeps.
+// Replaying the journal onto the saved file rebuilds the text
+// after a crash; a torn last record is detected by its checksum and dropped.
+class EditJournal {
+   public:
+    struct Edit {
+        unsigned long long version;
+        bool insertion;
+        // Set when `amount` characters at pos were put back at `to`, a
+        // position in the text without them.
+        bool move;
+        long long pos;
+        // Characters erased or moved; unused for insertions.
+        long long amount;
+        long long to;
+        // UTF-8 text inserted.
+        std::string text;
+    };
+
+    EditJournal();
+    ~EditJournal();
+
+    EditJournal(const EditJournal &) = delete;
+    EditJournal &operator=(const EditJournal &) = delete;
+
+    // Calls apply() with every edit recorded for `filename`, in order, if the
+    // journal was written against the file as it is now. baseVersion is the
+    // version the file was saved at and lastVersion the one of the last edit.
+    static bool replay(const std::string &filename, const std::function<bool(const Edit &)> &apply,
+        unsigned long long &baseVersion, unsigned long long &lastVersion);
+
+    // Starts journaling `filename`. Existing records are kept when `resume`
+    // is set (after a replay), otherwise the journal starts empty.
+    bool open(const std::string &filename, unsigned long long baseVersion, bool resume);
+    // Stops journaling. The journal file is deleted when `discard` is set.
+    void close(bool discard);
+    bool isOpen() const;
+
+    void recordInsert(unsigned long long version, long long pos, const sf::String &text);
+    void recordErase(unsigned long long version, long long pos, long long amount);
+    void recordMove(unsigned long long version, long long from, long long amount, long long to);
+    void flush();
+
+    // Called once the document has been saved at `savedVersion` to
+    // `filename`: the journal is rewritten against that file, keeping only
+    // the later edits. Also starts journaling if it was not running yet.
+    bool rebase(const std::string &filename, unsigned long long savedVersion);
+
+    static std::string journalFilename(const std::string &filename);
+
+    static const int FLUSH_INTERVAL_MS = 500;
+
+   private:
+    // Held while writing to the journal file, which keeps the writes in
+    // order; taken before `mutex` when both are needed. Guards the two below.
+    std::mutex fileMutex;
+    std::string filename;
+    std::FILE *file;
+
+    // Guards what follows, and is never held while waiting for the disk, so
+    // recording an edit does not wait for a sync or a rebase.
+    mutable std::mutex mutex;
+    std::vector<char> pending;
+    // Set from open() to close(). The file may be closed for a moment
+    // meanwhile, while rebase() rewrites it.
+    bool recording;
+
+    std::thread flusher;
+    std::condition_variable wake;
+    bool stopping;
+
+    void writePending();
+    void writePendingLocked();
+    void flushLoop();
+    void append(unsigned long long version, int kind, long long pos, long long amount, long long to,
+        const char *text, std::size_t textBytes);
+
+    static std::string header(const std::string &filename, unsigned long long baseVersion);
+};
+
+#endif
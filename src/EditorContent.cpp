@@ -1,55 +1,299 @@
 #include "EditorContent.h"
 
-constexpr int TAB_WIDTH = 4;
+#include <algorithm>
+
+namespace {
+
+std::pair<int, int> startOf(const SelectionData::Selection &selection) {
+    return std::pair<int, int>(SelectionData::getStartLineN(selection), SelectionData::getStartCharN(selection));
+}
+
+std::pair<int, int> endOf(const SelectionData::Selection &selection) {
+    return std::pair<int, int>(SelectionData::getEndLineN(selection), SelectionData::getEndCharN(selection));
+}
+
+std::pair<int, int> positionOf(Cursor &cursor) {
+    return std::pair<int, int>(cursor.getLineN(), cursor.getCharN());
+}
+
+SelectionData::Selection collapsedAt(Cursor &cursor) {
+    return SelectionData::Selection(cursor.getLineN(), cursor.getCharN(), cursor.getLineN(), cursor.getCharN());
+}
+
+}  // namespace
 
 EditorContent::EditorContent(TextDocument &textDocument) :
-    document(textDocument) {
-    this->cursor = Cursor(0, 0);
+    document(textDocument), primaryCursor(0), cursorVersion(0), anchorsStale(true), columns(textDocument) {
+    this->cursors.push_back(Cursor(0, 0));
+    this->selections.assign({collapsedAt(this->cursors[0])});
+    this->document.addLinesChangedListener([this](int firstLine, int lastLine) {
+        this->changedLines.add(firstLine, lastLine);
+    });
 }
 
 std::pair<int, int> EditorContent::cursorPosition() {
-    int lineN = this->cursor.getLineN();
-    int charN = this->cursor.getCharN();
-    int column = this->getColumnFromCharN(lineN, charN);
+    std::pair<int, int> position = this->cursorCharPosition();
+    int column = this->getColumnFromCharN(position.first, position.second);
+
+    return std::pair<int, int>(position.first, column);
+}
 
-    return std::pair<int, int>(lineN, column);
+std::pair<int, int> EditorContent::cursorCharPosition() {
+    return positionOf(this->cursors[this->primaryCursor]);
 }
 
-void EditorContent::createNewSelection(int anclaLine, int anclaChar) {
-    this->selections.createNewSelection(anclaLine, anclaChar);
+void EditorContent::getCursorsInLines(int firstLine, int lastLine, std::vector<std::pair<int, int>> &positions) {
+    auto it = std::lower_bound(this->cursors.begin(), this->cursors.end(), firstLine,
+        [](Cursor &cursor, int lineN) { return cursor.getLineN() < lineN; });
+    for (; it != this->cursors.end() && it->getLineN() <= lastLine; ++it) {
+        positions.emplace_back(it->getLineN(), this->getColumnFromCharN(it->getLineN(), it->getCharN()));
+    }
+}
+
+unsigned long long EditorContent::getCursorVersion() {
+    return this->cursorVersion;
 }
 
-void EditorContent::createNewSelectionFromCursor() {
-    this->createNewSelection(this->cursor.getLineN(), this->cursor.getCharN());
+int EditorContent::cursorCount() {
+    return this->cursors.size();
 }
 
-void EditorContent::updateLastSelection(int lineN, int charN) {
-    this->selections.updateLastSelection(lineN, charN);
+// Changes to the cursors go between these two. The end puts the cursors back
+// in order and marks the lines whose highlight changed.
+void EditorContent::beginCursorChange() {
+    this->selectionsBefore.clear();
+    for (int i = 0; i < this->selections.count(); i++) {
+        this->selectionsBefore.push_back(this->selections.get(i));
+    }
+}
+
+void EditorContent::endCursorChange() {
+    this->normalizeCursors();
+    this->cursorVersion++;
+    this->anchorsStale = true;
+
+    int count = this->selections.count();
+    if ((int)this->selectionsBefore.size() != count) {
+        for (const SelectionData::Selection &before : this->selectionsBefore) {
+            if (before.activa) {
+                this->changedLines.add(SelectionData::getStartLineN(before), SelectionData::getEndLineN(before));
+            }
+        }
+        this->selections.addSelectedLines(this->changedLines);
+        return;
+    }
+
+    // Only the lines between the old and the new end of a selection changed
+    // highlight, unless the selection just appeared or disappeared.
+    for (int i = 0; i < count; i++) {
+        const SelectionData::Selection &before = this->selectionsBefore[i];
+        SelectionData::Selection after = this->selections.get(i);
+        bool sameAncla = before.ancla.lineN == after.ancla.lineN && before.ancla.charN == after.ancla.charN;
+        bool sameExtremo = before.extremo.lineN == after.extremo.lineN && before.extremo.charN == after.extremo.charN;
+
+        if (before.activa && after.activa && sameAncla) {
+            if (!sameExtremo) {
+                this->changedLines.add(std::min(before.extremo.lineN, after.extremo.lineN),
+                    std::max(before.extremo.lineN, after.extremo.lineN));
+            }
+            continue;
+        }
+        if (before.activa) {
+            this->changedLines.add(SelectionData::getStartLineN(before), SelectionData::getEndLineN(before));
+        }
+        if (after.activa) {
+            this->changedLines.add(SelectionData::getStartLineN(after), SelectionData::getEndLineN(after));
+        }
+    }
+}
+
+// Cursors that ended up in the same place, or whose selections overlap,
+// become one, with a selection covering both.
+void EditorContent::normalizeCursors() {
+    struct Caret {
+        Cursor cursor;
+        SelectionData::Selection selection;
+        bool primary;
+    };
+    std::vector<Caret> carets;
+    carets.reserve(this->cursors.size());
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        carets.push_back({this->cursors[i], this->selections.get(i), (int)i == this->primaryCursor});
+    }
+    auto byStart = [](const Caret &a, const Caret &b) { return startOf(a.selection) < startOf(b.selection); };
+    if (!std::is_sorted(carets.begin(), carets.end(), byStart)) {
+        std::stable_sort(carets.begin(), carets.end(), byStart);
+    }
+
+    std::vector<Caret> merged;
+    merged.reserve(carets.size());
+    for (Caret &caret : carets) {
+        if (merged.empty()) {
+            merged.push_back(caret);
+            continue;
+        }
+        Caret &last = merged.back();
+        std::pair<int, int> start = startOf(last.selection);
+        std::pair<int, int> end = std::max(endOf(last.selection), endOf(caret.selection));
+        if (positionOf(caret.cursor) != positionOf(last.cursor) && !(startOf(caret.selection) < endOf(last.selection))) {
+            merged.push_back(caret);
+            continue;
+        }
+
+        bool forward = positionOf(caret.cursor) == endOf(caret.selection);
+        std::pair<int, int> ancla = forward ? start : end;
+        std::pair<int, int> extremo = forward ? end : start;
+        if (positionOf(caret.cursor) == extremo) {
+            last.cursor = caret.cursor;
+        } else if (positionOf(last.cursor) != extremo) {
+            last.cursor.setPosition(extremo.first, extremo.second, true);
+        }
+        last.selection = SelectionData::Selection(ancla.first, ancla.second, extremo.first, extremo.second);
+        last.primary = last.primary || caret.primary;
+    }
+
+    this->cursors.clear();
+    std::vector<SelectionData::Selection> selections;
+    selections.reserve(merged.size());
+    this->primaryCursor = merged.size() - 1;
+    for (std::size_t i = 0; i < merged.size(); i++) {
+        this->cursors.push_back(merged[i].cursor);
+        selections.push_back(merged[i].selection);
+        if (merged[i].primary) {
+            this->primaryCursor = i;
+        }
+    }
+    this->selections.assign(std::move(selections));
 }
 
 void EditorContent::removeSelections() {
-    this->selections.removeSelections();
+    this->beginCursorChange();
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        this->selections.set(i, collapsedAt(this->cursors[i]));
+    }
+    this->endCursorChange();
 }
 
 bool EditorContent::isSelected(int lineNumber, int charIndexInLine) {
     return this->selections.isSelected(lineNumber, charIndexInLine);
 }
 
+void EditorContent::getSelectedSpans(int firstLine, int lastLine, std::vector<SelectionData::Span> &spans) {
+    this->selections.getSpans(firstLine, lastLine, spans);
+}
+
 SelectionData::Selection EditorContent::getLastSelection() {
-    return this->selections.getLastSelection();
+    return this->selections.get(this->primaryCursor);
 }
 
+void EditorContent::addCursor(int lineN, int charN) {
+    this->beginCursorChange();
+    Cursor cursor(lineN, charN);
+    cursor.setMaxCharNReached(charN);
+    std::vector<SelectionData::Selection> selections = this->selectionsBefore;
+    selections.push_back(collapsedAt(cursor));
+
+    this->cursors.push_back(cursor);
+    this->selections.assign(std::move(selections));
+    this->primaryCursor = this->cursors.size() - 1;
+    this->endCursorChange();
+}
+
+void EditorContent::addCursorsVertically(bool up) {
+    this->beginCursorChange();
+    std::vector<SelectionData::Selection> selections = this->selectionsBefore;
+    int count = this->cursors.size();
+    for (int i = 0; i < count; i++) {
+        int lineN = this->cursors[i].getLineN() + (up ? -1 : 1);
+        if (lineN < 0 || lineN >= this->document.getLineCount()) {
+            continue;
+        }
+        int maxCharN = this->cursors[i].getMaxCharNReached();
+        Cursor cursor(lineN, std::min(maxCharN, this->document.charsInLine(lineN)));
+        cursor.setMaxCharNReached(maxCharN);
+        this->cursors.push_back(cursor);
+        selections.push_back(collapsedAt(cursor));
+    }
+    this->selections.assign(std::move(selections));
+    this->endCursorChange();
+}
+
+void EditorContent::keepPrimaryCursor() {
+    if (this->cursors.size() == 1) {
+        return;
+    }
+    this->beginCursorChange();
+    Cursor primary = this->cursors[this->primaryCursor];
+    this->cursors.assign(1, primary);
+    this->selections.assign({this->selectionsBefore[this->primaryCursor]});
+    this->primaryCursor = 0;
+    this->endCursorChange();
+}
+
+void EditorContent::selectAllOccurrences() {
+    SelectionData::Selection selection = this->getLastSelection();
+    int selectionLine = SelectionData::getStartLineN(selection);
+    if (!selection.activa || selectionLine != SelectionData::getEndLineN(selection)) {
+        return;
+    }
+    int startCharN = SelectionData::getStartCharN(selection);
+    sf::String needle = this->document.getTextFromPos(
+        SelectionData::getEndCharN(selection) - startCharN, selectionLine, startCharN);
+
+    this->beginCursorChange();
+    std::vector<SelectionData::Selection> selections = this->selectionsBefore;
+    for (int lineN = 0; lineN < this->document.getLineCount(); lineN++) {
+        sf::String line = this->document.getLine(lineN);
+        std::size_t found = line.find(needle);
+        while (found != sf::String::InvalidPos) {
+            int endCharN = found + needle.getSize();
+            Cursor cursor(lineN, endCharN);
+            cursor.setMaxCharNReached(endCharN);
+            this->cursors.push_back(cursor);
+            selections.push_back(SelectionData::Selection(lineN, found, lineN, endCharN));
+            found = line.find(needle, endCharN);
+        }
+    }
+    this->selections.assign(std::move(selections));
+    this->endCursorChange();
+}
+
+// Every line with a cursor gets a copy below it, and its cursors move down to
+// the copy.
 void EditorContent::duplicateCursorLine() {
     this->removeSelections();
 
-    int lineN = this->cursor.getLineN();
-    sf::String lineToAdd = this->document.getLine(lineN);
-    lineToAdd += '\n';
-    this->document.addTextToPos(lineToAdd, lineN + 1, 0);
-    this->moveCursorDown();
+    std::vector<int> lines;
+    for (Cursor &cursor : this->cursors) {
+        if (lines.empty() || lines.back() != cursor.getLineN()) {
+            lines.push_back(cursor.getLineN());
+        }
+    }
+    this->document.beginEdit();
+    for (int lineN : lines) {
+        sf::String lineToAdd = "\n";
+        lineToAdd += this->document.getLine(lineN);
+        this->document.replace(lineN, this->document.charsInLine(lineN), 0, lineToAdd);
+    }
+    if (!this->document.commit()) {
+        return;
+    }
+
+    this->beginCursorChange();
+    std::size_t copiedAbove = 0;
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        Cursor &cursor = this->cursors[i];
+        while (copiedAbove < lines.size() && lines[copiedAbove] <= cursor.getLineN()) {
+            copiedAbove++;
+        }
+        cursor.setPosition(cursor.getLineN() + copiedAbove, cursor.getCharN());
+        this->selections.set(i, collapsedAt(cursor));
+    }
+    this->endCursorChange();
 }
 
 void EditorContent::swapSelectedLines(bool swapWithUp) {
+    this->keepPrimaryCursor();
     auto lastSelection = this->getLastSelection();
     if (!lastSelection.activa) {
         this->swapCursorLine(swapWithUp);
@@ -58,183 +302,390 @@ void EditorContent::swapSelectedLines(bool swapWithUp) {
     int rangeStart = SelectionData::getStartLineN(lastSelection);
     int rangeEnd = SelectionData::getEndLineN(lastSelection);
 
-    int startLineN = SelectionData::getStartLineN(lastSelection);
-    int startCharN = SelectionData::getStartCharN(lastSelection);
-    int endLineN = SelectionData::getEndLineN(lastSelection);
-    int endCharN = SelectionData::getEndCharN(lastSelection);
+    this->moveLineBlock(rangeStart, rangeEnd, swapWithUp);
+}
 
-    if (swapWithUp && rangeStart > 0) {
-        for (int i = rangeStart; i <= rangeEnd; i++) {
-            this->document.swapLines(i, i - 1);
-        }
-        this->removeSelections();
-        this->createNewSelection(startLineN - 1, startCharN);
-        this->updateLastSelection(endLineN - 1, endCharN);
+void EditorContent::swapCursorLine(bool swapWithUp) {
+    this->keepPrimaryCursor();
+    int currentLine = this->cursors[this->primaryCursor].getLineN();
+    this->moveLineBlock(currentLine, currentLine, swapWithUp);
+}
 
-    } else if (!swapWithUp && rangeEnd < this->document.getLineCount() - 1) {
-        for (int i = rangeEnd; i >= rangeStart; i--) {
-            this->document.swapLines(i, i + 1);
+bool EditorContent::moveLineBlock(int firstLine, int lastLine, bool up) {
+    if (up ? firstLine <= 0 : lastLine >= this->document.getLineCount() - 1) {
+        return false;
+    }
+    this->anchorCursors();
+    if (!this->document.moveLines(firstLine, lastLine, up ? -1 : 1)) {
+        return false;
+    }
+    this->beginCursorChange();
+    this->followAnchors();
+    this->endCursorChange();
+    return true;
+}
+
+void EditorContent::moveLeft(Cursor &cursor) {
+    if (cursor.getCharN() <= 0) {
+        int newCursorLine = std::max(cursor.getLineN() - 1, 0);
+        int newCursorChar = 0;
+        if (cursor.getLineN() != 0) {
+            newCursorChar = this->document.charsInLine(newCursorLine);
         }
-        this->removeSelections();
-        this->createNewSelection(startLineN + 1, startCharN);
-        this->updateLastSelection(endLineN + 1, endCharN);
+        cursor.setPosition(newCursorLine, newCursorChar, true);
+    } else {
+        cursor.moveLeft(true);
     }
 }
 
-void EditorContent::swapCursorLine(bool swapWithUp) {
-    int currentLine = this->cursor.getLineN();
-    if (swapWithUp) {
-        this->document.swapLines(currentLine, std::max(currentLine - 1, 0));
+void EditorContent::moveRight(Cursor &cursor) {
+    int charsInLine = this->document.charsInLine(cursor.getLineN());
+    if (cursor.getCharN() >= charsInLine) {
+        int newCursorLine = std::min(cursor.getLineN() + 1, this->document.getLineCount() - 1);
+        if (newCursorLine != cursor.getLineN()) {
+          cursor.setPosition(newCursorLine, 0, true);
+        }
     } else {
-        this->document.swapLines(currentLine, std::min(currentLine + 1, this->document.getLineCount() - 1));
+        cursor.moveRight(true);
     }
 }
 
-bool EditorContent::moveCursorLeft(bool updateActiveSelections) {
-    bool moved = (this->cursor.getLineN() != 0)
-    || ((this->cursor.getLineN() == 0) && (this->cursor.getCharN() > 0));
+void EditorContent::moveUp(Cursor &cursor) {
+    if (cursor.getLineN() > 0) {
+        int charsInPreviousLine = this->document.charsInLine(cursor.getLineN() - 1);
+        int currentCharPos = cursor.getCharN();
 
-    if (this->cursor.getCharN() <= 0) {
-        int newCursorLine = std::max(this->cursor.getLineN() - 1, 0);
-        int newCursorChar = 0;
-        if (this->cursor.getLineN() != 0) {
-            newCursorChar = this->document.charsInLine(newCursorLine);
+        if (currentCharPos <= charsInPreviousLine && cursor.getMaxCharNReached() <= charsInPreviousLine) {
+            cursor.moveUpToMaxCharN();
+        } else {
+            cursor.setPosition(cursor.getLineN() - 1, charsInPreviousLine);
         }
-        this->cursor.setPosition(newCursorLine, newCursorChar, true);
-    } else {
-        this->cursor.moveLeft(true);
     }
+}
 
+void EditorContent::moveDown(Cursor &cursor) {
+    if (cursor.getLineN() < this->document.getLineCount() - 1) {
+        int charsInNextLine = this->document.charsInLine(cursor.getLineN() + 1);
+        int currentCharPos = cursor.getCharN();
+
+        if (currentCharPos <= charsInNextLine && cursor.getMaxCharNReached() <= charsInNextLine) {
+            cursor.moveDownToMaxCharN();
+        } else {
+            cursor.setPosition(cursor.getLineN() + 1, charsInNextLine);
+        }
+    }
+}
+
+bool EditorContent::moveCursorLeft(bool updateActiveSelections) {
+    this->beginCursorChange();
+    bool moved = false;
+    for (Cursor &cursor : this->cursors) {
+        moved = moved || cursor.getLineN() != 0 || cursor.getCharN() > 0;
+        this->moveLeft(cursor);
+    }
     this->handleSelectionOnCursorMovement(updateActiveSelections);
+    this->endCursorChange();
 
     return moved;
 }
 
 void EditorContent::moveCursorRight(bool updateActiveSelections) {
-    int charsInLine = this->document.charsInLine(this->cursor.getLineN());
-    if (this->cursor.getCharN() >= charsInLine) {
-        int newCursorLine = std::min(this->cursor.getLineN() + 1, this->document.getLineCount() - 1);
-        if (newCursorLine != this->cursor.getLineN()) {
-          this->cursor.setPosition(newCursorLine, 0, true);
-        }
-    } else {
-        this->cursor.moveRight(true);
+    this->beginCursorChange();
+    for (Cursor &cursor : this->cursors) {
+        this->moveRight(cursor);
     }
-
     this->handleSelectionOnCursorMovement(updateActiveSelections);
+    this->endCursorChange();
 }
 
 void EditorContent::moveCursorUp(bool updateActiveSelections) {
-    if (this->cursor.getLineN() > 0) {
-        int charsInPreviousLine = this->document.charsInLine(this->cursor.getLineN() - 1);
-        int currentCharPos = this->cursor.getCharN();
-
-        if (currentCharPos <= charsInPreviousLine && this->cursor.getMaxCharNReached() <= charsInPreviousLine) {
-            this->cursor.moveUpToMaxCharN();
-        } else {
-            this->cursor.setPosition(this->cursor.getLineN() - 1, charsInPreviousLine);
-        }
+    this->beginCursorChange();
+    for (Cursor &cursor : this->cursors) {
+        this->moveUp(cursor);
     }
-
     this->handleSelectionOnCursorMovement(updateActiveSelections);
+    this->endCursorChange();
 }
 
 void EditorContent::moveCursorDown(bool updateActiveSelections) {
-    if (this->cursor.getLineN() < this->document.getLineCount() - 1) {
-        int charsInNextLine = this->document.charsInLine(this->cursor.getLineN() + 1);
-        int currentCharPos = this->cursor.getCharN();
-
-        if (currentCharPos <= charsInNextLine && this->cursor.getMaxCharNReached() <= charsInNextLine) {
-            this->cursor.moveDownToMaxCharN();
-        } else {
-            this->cursor.setPosition(this->cursor.getLineN() + 1, charsInNextLine);
-        }
+    this->beginCursorChange();
+    for (Cursor &cursor : this->cursors) {
+        this->moveDown(cursor);
     }
-
     this->handleSelectionOnCursorMovement(updateActiveSelections);
+    this->endCursorChange();
 }
 
 void EditorContent::moveCursorToEnd(bool updateActiveSelections) {
-    int charsInLine = this->document.charsInLine(this->cursor.getLineN());
-    this->cursor.moveToEnd(charsInLine, true);
+    this->beginCursorChange();
+    for (Cursor &cursor : this->cursors) {
+        cursor.moveToEnd(this->document.charsInLine(cursor.getLineN()), true);
+    }
     this->handleSelectionOnCursorMovement(updateActiveSelections);
+    this->endCursorChange();
 }
 
 void EditorContent::moveCursorToStart(bool updateActiveSelections) {
-    this->cursor.moveToStart(true);
+    this->beginCursorChange();
+    for (Cursor &cursor : this->cursors) {
+        cursor.moveToStart(true);
+    }
     this->handleSelectionOnCursorMovement(updateActiveSelections);
+    this->endCursorChange();
+}
+
+void EditorContent::moveCursorTo(int lineN, int charN, bool updateActiveSelections) {
+    this->beginCursorChange();
+    this->document.breakUndoCoalescing();
+    Cursor &cursor = this->cursors[this->primaryCursor];
+    cursor.setPosition(lineN, charN);
+    cursor.setMaxCharNReached(charN);
+
+    SelectionData::Selection selection = this->selectionsBefore[this->primaryCursor];
+    if (updateActiveSelections) {
+        selection = SelectionData::Selection(selection.ancla.lineN, selection.ancla.charN, lineN, charN);
+    } else {
+        selection = collapsedAt(cursor);
+    }
+    this->selections.set(this->primaryCursor, selection);
+    this->endCursorChange();
 }
 
+std::pair<int, int> EditorContent::stepBack(std::pair<int, int> position, int amount) {
+    while (amount > 0) {
+        if (position.second > 0) {
+            int step = std::min(position.second, amount);
+            position.second -= step;
+            amount -= step;
+        } else if (position.first > 0) {
+            position.first--;
+            position.second = this->document.charsInLine(position.first);
+            amount--;
+        } else {
+            break;
+        }
+    }
+    return position;
+}
+
+std::pair<int, int> EditorContent::stepForward(std::pair<int, int> position, int amount) {
+    while (amount > 0) {
+        int charsInLine = this->document.charsInLine(position.first);
+        if (position.second < charsInLine) {
+            int step = std::min(charsInLine - position.second, amount);
+            position.second += step;
+            amount -= step;
+        } else if (position.first < this->document.getLineCount() - 1) {
+            position.first++;
+            position.second = 0;
+            amount--;
+        } else {
+            break;
+        }
+    }
+    return position;
+}
 
 void EditorContent::deleteTextBeforeCursorPos(int amount) {
-    int actuallyMoved = 0;
-    for (int i = 0; i < amount; i++) {
-        bool moved = this->moveCursorLeft();
-        actuallyMoved += moved ? 1 : 0;
+    std::vector<std::pair<Position, Position>> ranges;
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        SelectionData::Selection selection = this->selections.get(i);
+        if (selection.activa) {
+            ranges.emplace_back(startOf(selection), endOf(selection));
+        } else {
+            Position position = positionOf(this->cursors[i]);
+            ranges.emplace_back(this->stepBack(position, amount), position);
+        }
     }
-    this->deleteTextAfterCursorPos(actuallyMoved);
+    this->replaceAtCursors(ranges, "");
 }
 
 void EditorContent::deleteTextAfterCursorPos(int amount) {
-    int newLineN = this->cursor.getLineN();
-    int newCharN = this->cursor.getCharN();
-    this->document.removeTextFromPos(amount, newLineN, newCharN);
+    std::vector<std::pair<Position, Position>> ranges;
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        SelectionData::Selection selection = this->selections.get(i);
+        if (selection.activa) {
+            ranges.emplace_back(startOf(selection), endOf(selection));
+        } else {
+            Position position = positionOf(this->cursors[i]);
+            ranges.emplace_back(position, this->stepForward(position, amount));
+        }
+    }
+    this->replaceAtCursors(ranges, "");
 }
 
-
 void EditorContent::addTextInCursorPos(sf::String text) {
-    int textSize = text.getSize();
-    int lineN = this->cursor.getLineN();
-    int charN = this->cursor.getCharN();
+    std::vector<std::pair<Position, Position>> ranges;
+    for (int i = 0; i < this->selections.count(); i++) {
+        SelectionData::Selection selection = this->selections.get(i);
+        ranges.emplace_back(startOf(selection), endOf(selection));
+    }
+    this->replaceAtCursors(ranges, text);
+}
 
-    this->document.addTextToPos(text, lineN, charN);
-    for (int i = 0; i < textSize; i++) {
-        this->moveCursorRight();
+// Range i, from its first to its second position, goes with cursor i. The
+// ranges that overlap make a single edit. Cursors and selection starts in a
+// range are marks in it, so they all end up after the text put in.
+void EditorContent::replaceAtCursors(const std::vector<std::pair<Position, Position>> &ranges,
+    const sf::String &text) {
+    // Cursors are in order, but a selection can start before the range of
+    // the cursor ahead of it.
+    std::vector<int> order(ranges.size());
+    for (std::size_t i = 0; i < ranges.size(); i++) {
+        order[i] = i;
     }
+    std::stable_sort(order.begin(), order.end(), [&ranges](int a, int b) { return ranges[a].first < ranges[b].first; });
+
+    std::vector<TextDocument::Edit> edits;
+    std::vector<Position> editEnds;
+    for (int i : order) {
+        const std::pair<Position, Position> &range = ranges[i];
+        if (!edits.empty() && range.first < editEnds.back()) {
+            editEnds.back() = std::max(editEnds.back(), range.second);
+        } else {
+            edits.push_back({range.first.first, range.first.second, 0, text});
+            editEnds.push_back(range.second);
+        }
+    }
+    for (std::size_t i = 0; i < edits.size(); i++) {
+        if (editEnds[i] != Position(edits[i].lineN, edits[i].charN)) {
+            edits[i].amount = this->document.charAmountContained(edits[i].lineN, edits[i].charN,
+                editEnds[i].first, editEnds[i].second) - 1;
+        }
+    }
+
+    this->anchorCursors();
+    this->beginCursorChange();
+    std::vector<Position> textEnds;
+    if (this->document.applyEdits(edits, textEnds)) {
+        this->followAnchors();
+    }
+    this->endCursorChange();
+    // Marks keep their order, so unless cursors met they are still cursor
+    // i's.
+    this->anchorsStale = this->anchors.size() != this->cursors.size();
 }
 
-bool EditorContent::deleteSelections() {
-    SelectionData::Selection lastSelection = this->getLastSelection();
-    this->removeSelections();
+// A cursor without a selection has no mark for its start: marks in the same
+// place always stay together.
+void EditorContent::anchorCursors() {
+    if (!this->anchorsStale) {
+        return;
+    }
+    this->anchorsStale = false;
+    while (this->anchors.size() > this->cursors.size()) {
+        if (this->anchors.back().first >= 0) {
+            this->document.removeMark(this->anchors.back().first);
+        }
+        this->document.removeMark(this->anchors.back().second);
+        this->anchors.pop_back();
+    }
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        SelectionData::Selection selection = this->selections.get(i);
+        Cursor &cursor = this->cursors[i];
+        if (i == this->anchors.size()) {
+            this->anchors.emplace_back(-1, this->document.addMark(cursor.getLineN(), cursor.getCharN()));
+        } else {
+            this->document.setMark(this->anchors[i].second, cursor.getLineN(), cursor.getCharN());
+        }
 
-    if (lastSelection.activa) {
-        int startLineN = SelectionData::getStartLineN(lastSelection);
-        int startCharN = SelectionData::getStartCharN(lastSelection);
-        int endLineN = SelectionData::getEndLineN(lastSelection);
-        int endCharN = SelectionData::getEndCharN(lastSelection);
+        int &anclaMark = this->anchors[i].first;
+        if (!selection.activa) {
+            if (anclaMark >= 0) {
+                this->document.removeMark(anclaMark);
+                anclaMark = -1;
+            }
+        } else if (anclaMark < 0) {
+            anclaMark = this->document.addMark(selection.ancla.lineN, selection.ancla.charN);
+        } else {
+            this->document.setMark(anclaMark, selection.ancla.lineN, selection.ancla.charN);
+        }
+    }
+}
 
-        this->cursor.setPosition(startLineN, startCharN, true);
+// Puts the cursors and their selections back where their marks went.
+void EditorContent::followAnchors() {
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        int lineN, charN;
+        this->document.getMark(this->anchors[i].second, lineN, charN);
+        this->cursors[i].setPosition(lineN, charN, true);
 
-        int amount = this->document.charAmountContained(startLineN, startCharN, endLineN, endCharN) - 1;
-        this->deleteTextAfterCursorPos(amount);
+        int anclaLine = lineN, anclaChar = charN;
+        if (this->anchors[i].first >= 0) {
+            this->document.getMark(this->anchors[i].first, anclaLine, anclaChar);
+        }
+        this->selections.set(i, SelectionData::Selection(anclaLine, anclaChar, lineN, charN));
     }
+}
 
-    return lastSelection.activa;
+bool EditorContent::undo() {
+    int lineN, charN;
+    if (!this->document.undo(lineN, charN)) {
+        return false;
+    }
+    this->resetCursor(lineN, charN);
+    return true;
 }
 
-sf::String EditorContent::copySelections() {
-    SelectionData::Selection lastSelection = this->getLastSelection();
+bool EditorContent::redo() {
+    int lineN, charN;
+    if (!this->document.redo(lineN, charN)) {
+        return false;
+    }
+    this->resetCursor(lineN, charN);
+    return true;
+}
 
-    sf::String copied = "";
-    if (lastSelection.activa) {
-        int startLineN = SelectionData::getStartLineN(lastSelection);
-        int startCharN = SelectionData::getStartCharN(lastSelection);
-        int endLineN = SelectionData::getEndLineN(lastSelection);
-        int endCharN = SelectionData::getEndCharN(lastSelection);
+bool EditorContent::deleteSelections() {
+    bool anyActive = false;
+    std::vector<std::pair<Position, Position>> ranges;
+    for (int i = 0; i < this->selections.count(); i++) {
+        SelectionData::Selection selection = this->selections.get(i);
+        anyActive = anyActive || selection.activa;
+        ranges.emplace_back(startOf(selection), endOf(selection));
+    }
+    if (anyActive) {
+        this->replaceAtCursors(ranges, "");
+    }
+    return anyActive;
+}
 
-        this->cursor.setPosition(startLineN, startCharN, true);
+// Selections are copied in document order, one per line.
+sf::String EditorContent::copySelections() {
+    sf::String copied = "";
+    bool first = true;
+    for (int i = 0; i < this->selections.count(); i++) {
+        SelectionData::Selection selection = this->selections.get(i);
+        if (!selection.activa) {
+            continue;
+        }
+        int startLineN = SelectionData::getStartLineN(selection);
+        int startCharN = SelectionData::getStartCharN(selection);
+        int endLineN = SelectionData::getEndLineN(selection);
+        int endCharN = SelectionData::getEndCharN(selection);
 
         int amount = this->document.charAmountContained(startLineN, startCharN, endLineN, endCharN) - 1;
-        copied = this->document.getTextFromPos(amount, startLineN, startCharN);
+        if (!first) {
+            copied += '\n';
+        }
+        copied += this->document.getTextFromPos(amount, startLineN, startCharN);
+        first = false;
     }
     return copied;
 }
 
 void EditorContent::handleSelectionOnCursorMovement(bool updateActiveSelections) {
-    if (updateActiveSelections) {
-        this->updateLastSelection(this->cursor.getLineN(), this->cursor.getCharN());
-    } else {
-        this->removeSelections();
+    this->document.breakUndoCoalescing();
+    for (std::size_t i = 0; i < this->cursors.size(); i++) {
+        SelectionData::Selection selection = this->selections.get(i);
+        if (updateActiveSelections) {
+            Cursor &cursor = this->cursors[i];
+            selection = SelectionData::Selection(selection.ancla.lineN, selection.ancla.charN,
+                cursor.getLineN(), cursor.getCharN());
+        } else {
+            selection = collapsedAt(this->cursors[i]);
+        }
+        this->selections.set(i, selection);
     }
 }
 
@@ -242,8 +693,7 @@ int EditorContent::linesCount() {
     return this->document.getLineCount();
 }
 
-// TODO: cols != chars
-int EditorContent::colsInLine(int line) {
+int EditorContent::charsInLine(int line) {
     return this->document.charsInLine(line);
 }
 
@@ -251,45 +701,57 @@ sf::String EditorContent::getLine(int line) {
     return this->document.getLine(line);
 }
 
+DirtyLines &EditorContent::getChangedLines() {
+    return this->changedLines;
+}
+
+sf::String EditorContent::getLineSlice(int line, int charN, int amount) {
+    return this->document.getTextFromPos(amount, line, charN);
+}
+
 sf::String EditorContent::getCursorLine() {
-    return this->getLine(cursor.getLineN());
+    return this->getLine(this->cursors[this->primaryCursor].getLineN());
 }
 
 void EditorContent::resetCursor(int line, int column) {
-    this->cursor.setPosition(line, column);
-    this->cursor.setMaxCharNReached(column);
+    this->document.breakUndoCoalescing();
+    this->beginCursorChange();
+    Cursor cursor(line, column);
+    cursor.setMaxCharNReached(column);
+    this->cursors.assign(1, cursor);
+    this->selections.assign({collapsedAt(cursor)});
+    this->primaryCursor = 0;
+    this->endCursorChange();
 }
 
+// First character starting at or after `column`.
 int EditorContent::getCharIndexOfColumn(int lineN, int column) {
-    sf::String line = this->getLine(lineN);
-    int len = this->colsInLine(lineN);
-    int currentCol = 0;
-    for (int charN = 0; charN < len; charN++) {
-
-        if (column <= currentCol) {
-            return charN;
-        }
-
-        if (line[charN] == '\t') {
-            currentCol += TAB_WIDTH;
-        } else {
-            currentCol++;
-        }
+    int charColumn;
+    int charN = this->columns.charAt(lineN, column, charColumn);
+    // Inside a wide character, the boundary is the one after it, past the
+    // marks that combine with it.
+    if (charColumn < column) {
+        charN = this->columns.charAt(lineN, this->columns.columnOf(lineN, charN + 1), charColumn);
     }
-    return len; 
+    return charN;
 }
 
 int EditorContent::getColumnFromCharN(int lineN, int charN) {
-    sf::String line = this->getLine(lineN);
+    return this->columns.columnOf(lineN, charN);
+}
 
-    int currentCol = 0;
-    for (int charNact = 0; charNact < charN; charNact++) {
-        if (line[charNact] == '\t') {
-            currentCol += 4;
-        } else {
-            currentCol++;
-        }
-    }
+int EditorContent::getCharAtColumn(int lineN, int column, int &charColumn) {
+    return this->columns.charAt(lineN, column, charColumn);
+}
+
+int EditorContent::longestLineWidth() {
+    return this->document.getLongestLineWidth();
+}
+
+int EditorContent::getTabWidth() {
+    return this->document.getTabWidth();
+}
 
-    return currentCol;
+void EditorContent::setTabWidth(int tabWidth) {
+    this->document.setTabWidth(tabWidth);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define EditorContent_H
 
 #include <SFML/Graphics.hpp>
+#include "LineColumnIndex.h"
 #include "SelectionData.h"
 #include "TextDocument.h"
 #include "Cursor.h"
@@ -10,18 +11,30 @@ class EditorContent {
    public:
     EditorContent(TextDocument &textDocument);
 
-    void createNewSelection(int anclaLine, int anclaChar);
-    void createNewSelectionFromCursor();
-    void updateLastSelection(int lineN, int charN);
-
+    // Collapses every selection onto its cursor.
     void removeSelections();
+    // Selection of the primary cursor.
     SelectionData::Selection getLastSelection();
 
+    // There is always at least one cursor. The primary one is the last
+    // added, and commands that work on a single cursor keep only that one.
+    void addCursor(int lineN, int charN);
+    // Adds a cursor on the line above (or below) each one.
+    void addCursorsVertically(bool up);
+    void keepPrimaryCursor();
+    // Selects every other occurrence of the primary selection, each with a
+    // cursor of its own. Occurrences are only looked for within lines.
+    void selectAllOccurrences();
+    int cursorCount();
+
     void duplicateCursorLine();
+    // The moved lines take the cursor and its selection along.
     void swapCursorLine(bool swapWithUp);
     void swapSelectedLines(bool swapWithUp);
 
     bool isSelected(int lineNumber, int charIndexInLine);
+    // Selected parts of lines firstLine to lastLine, in order.
+    void getSelectedSpans(int firstLine, int lastLine, std::vector<SelectionData::Span> &spans);
     bool deleteSelections();
     sf::String copySelections();
     bool moveCursorLeft(bool updateActiveSelections=false);
@@ -31,29 +44,86 @@ class EditorContent {
 
     void moveCursorToEnd(bool updateActiveSelections=false);
     void moveCursorToStart(bool updateActiveSelections=false);
+    // Moves the primary cursor alone.
+    void moveCursorTo(int lineN, int charN, bool updateActiveSelections=false);
 
+    // Every cursor edits at once, in a single batch. A cursor with a
+    // selection replaces (or deletes) the selection instead.
     void addTextInCursorPos(sf::String text);
     void deleteTextAfterCursorPos(int amount);
     void deleteTextBeforeCursorPos(int amount);
 
+    bool undo();
+    bool redo();
+
+    // Lines whose text or selection changed since the view last cleared it.
+    DirtyLines &getChangedLines();
+
     int linesCount();
-    int colsInLine(int line);
+    int charsInLine(int line);
     sf::String getLine(int line);
+    sf::String getLineSlice(int line, int charN, int amount);
     sf::String getCursorLine();
 
+    // Leaves a single cursor, at `line` and character `column`.
     void resetCursor(int line, int column);
     std::pair<int, int> cursorPosition();
+    // Line and character index of the cursor, where cursorPosition() gives
+    // the column.
+    std::pair<int, int> cursorCharPosition();
+    // Line and column of every cursor on lines firstLine to lastLine, in
+    // order.
+    void getCursorsInLines(int firstLine, int lastLine, std::vector<std::pair<int, int>> &positions);
+    // Changes whenever a cursor moves, comes or goes.
+    unsigned long long getCursorVersion();
     int getCharIndexOfColumn(int lineN, int column);
     int getColumnFromCharN(int lineN, int charN);
+    // Character drawn over `column`, with the column it starts at.
+    int getCharAtColumn(int lineN, int column, int &charColumn);
+    // Columns of the widest line of the document.
+    int longestLineWidth();
+    int getTabWidth();
+    void setTabWidth(int tabWidth);
 
    private:
+    // Line and character index.
+    typedef std::pair<int, int> Position;
+
     TextDocument &document;
 
     sf::Font font;
-    Cursor cursor;
+    // In document order, never two at the same place, and never with
+    // overlapping selections. Selection i of `selections` is cursor i's.
+    std::vector<Cursor> cursors;
+    int primaryCursor;
     SelectionData selections;
+    unsigned long long cursorVersion;
+    // Selections as they were when the cursors started to change.
+    std::vector<SelectionData::Selection> selectionsBefore;
+    // Document marks of cursor i's selection start (-1 without a selection)
+    // and of the cursor itself, which edits keep in place. Only set again
+    // before an edit when the cursors moved since.
+    std::vector<std::pair<int, int>> anchors;
+    bool anchorsStale;
+    DirtyLines changedLines;
+    LineColumnIndex columns;
 
+    void beginCursorChange();
+    void endCursorChange();
+    void normalizeCursors();
     void handleSelectionOnCursorMovement(bool updateActiveSelections);
+    void moveLeft(Cursor &cursor);
+    void moveRight(Cursor &cursor);
+    void moveUp(Cursor &cursor);
+    void moveDown(Cursor &cursor);
+    bool moveLineBlock(int firstLine, int lastLine, bool up);
+    // Position `amount` characters before (or after) `position`, counting
+    // line breaks, without leaving the document.
+    Position stepBack(Position position, int amount);
+    Position stepForward(Position position, int amount);
+    void anchorCursors();
+    void followAnchors();
+    void replaceAtCursors(const std::vector<std::pair<Position, Position>> &ranges, const sf::String &text);
 };
 
 #endif
\ No newline at end of file
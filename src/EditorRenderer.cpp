@@ -0,0 +1,214 @@
+#include "EditorRenderer.h"
+
+#include <algorithm>
+
+namespace {
+
+void appendRect(sf::VertexArray &vertices, const sf::FloatRect &rect, const sf::Color &color) {
+    sf::Vector2f topLeft(rect.left, rect.top), topRight(rect.left + rect.width, rect.top);
+    sf::Vector2f bottomLeft(rect.left, rect.top + rect.height);
+    sf::Vector2f bottomRight(rect.left + rect.width, rect.top + rect.height);
+
+    vertices.append(sf::Vertex(topLeft, color));
+    vertices.append(sf::Vertex(topRight, color));
+    vertices.append(sf::Vertex(bottomLeft, color));
+    vertices.append(sf::Vertex(bottomLeft, color));
+    vertices.append(sf::Vertex(topRight, color));
+    vertices.append(sf::Vertex(bottomRight, color));
+}
+
+void appendTexturedRect(sf::VertexArray &vertices, const sf::FloatRect &rect, const sf::IntRect &textureRect) {
+    float left = rect.left, right = rect.left + rect.width;
+    float top = rect.top, bottom = rect.top + rect.height;
+    float u1 = textureRect.left, u2 = textureRect.left + textureRect.width;
+    float v1 = textureRect.top, v2 = textureRect.top + textureRect.height;
+
+    vertices.append(sf::Vertex(sf::Vector2f(left, top), sf::Vector2f(u1, v1)));
+    vertices.append(sf::Vertex(sf::Vector2f(right, top), sf::Vector2f(u2, v1)));
+    vertices.append(sf::Vertex(sf::Vector2f(left, bottom), sf::Vector2f(u1, v2)));
+    vertices.append(sf::Vertex(sf::Vector2f(left, bottom), sf::Vector2f(u1, v2)));
+    vertices.append(sf::Vertex(sf::Vector2f(right, top), sf::Vector2f(u2, v1)));
+    vertices.append(sf::Vertex(sf::Vector2f(right, bottom), sf::Vector2f(u2, v2)));
+}
+
+void appendFirst(sf::VertexArray &vertices, const sf::VertexArray &more, std::size_t count) {
+    for (std::size_t i = 0; i < count; i++) {
+        vertices.append(more[i]);
+    }
+}
+
+void drawIfAny(sf::RenderTarget &target, const sf::VertexArray *vertices, const sf::RenderStates &states) {
+    if (vertices && vertices->getVertexCount() > 0) {
+        target.draw(*vertices, states);
+    }
+}
+
+}  // namespace
+
+EditorRenderer::EditorRenderer(sf::RenderWindow &window)
+    : window(window), framePending(false), stopping(false),
+      tileVertices(sf::Triangles), backgroundVertices(sf::Triangles), textVertices(sf::Triangles) {}
+
+EditorRenderer::~EditorRenderer() {
+    this->stop();
+}
+
+void EditorRenderer::start() {
+    if (this->thread.joinable()) {
+        return;
+    }
+    this->stopping = false;
+    this->window.setActive(false);
+    this->thread = std::thread(&EditorRenderer::run, this);
+}
+
+void EditorRenderer::stop() {
+    if (!this->thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->wakeMutex);
+        this->stopping = true;
+    }
+    this->wake.notify_one();
+    this->thread.join();
+}
+
+DisplayList &EditorRenderer::getWriteBuffer() {
+    return this->displayLists.getWriteBuffer();
+}
+
+void EditorRenderer::publish() {
+    this->displayLists.publish();
+    {
+        std::lock_guard<std::mutex> lock(this->wakeMutex);
+        this->framePending = true;
+    }
+    this->wake.notify_one();
+}
+
+void EditorRenderer::run() {
+    this->window.setActive(true);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(this->wakeMutex);
+            this->wake.wait(lock, [this] { return this->framePending || this->stopping; });
+            if (this->stopping) {
+                break;
+            }
+            this->framePending = false;
+        }
+
+        if (this->displayLists.fetch()) {
+            this->draw(this->displayLists.getReadBuffer());
+        }
+    }
+    this->window.setActive(false);
+}
+
+// Tiles whose content changed since they were rastered are rastered again,
+// then every tile on screen is composited in a single draw call. When the
+// atlas has no room left (zoomed far out) the rest of the tiles are drawn
+// straight from their vertices this frame.
+void EditorRenderer::draw(const DisplayList &list) {
+    if (list.tileSize.x != this->tiles.getTileWidth() || list.tileSize.y != this->tiles.getTileHeight()) {
+        this->tiles.reset(list.tileSize.x, list.tileSize.y);
+    }
+
+    this->tileVertices.clear();
+    this->backgroundVertices.clear();
+    this->textVertices.clear();
+    this->tiles.beginFrame();
+    bool rastered = false;
+
+    for (const std::shared_ptr<const TileContent> &content : list.tiles) {
+        TileCache::Tile *tile = this->tiles.acquire(content->row, content->column);
+        if (!tile) {
+            appendFirst(this->backgroundVertices, content->background, content->ownBackgroundCount);
+            appendFirst(this->textVertices, content->text, content->ownTextCount);
+            continue;
+        }
+
+        if (tile->generation != content->generation) {
+            this->rasterTile(*tile, *content, list);
+            rastered = true;
+        }
+        appendTexturedRect(this->tileVertices, content->bounds, this->tiles.getSlotRect(*tile));
+    }
+
+    if (rastered) {
+        this->tiles.getAtlas().display();
+    }
+
+    this->window.clear();
+    this->window.setView(list.camera);
+    if (this->tileVertices.getVertexCount() > 0) {
+        // Tiles hold premultiplied colors: they were blended over transparency.
+        sf::RenderStates tileStates(&this->tiles.getAtlas().getTexture());
+        tileStates.blendMode = sf::BlendMode(sf::BlendMode::One, sf::BlendMode::OneMinusSrcAlpha);
+        this->window.draw(this->tileVertices, tileStates);
+    }
+    drawIfAny(this->window, &this->backgroundVertices, sf::RenderStates::Default);
+    drawIfAny(this->window, list.margin.get(), sf::RenderStates::Default);
+    {
+        std::lock_guard<std::mutex> lock(*list.fontMutex);
+        drawIfAny(this->window, &this->textVertices, list.textTexture);
+        drawIfAny(this->window, list.lineNumbers.get(), list.lineNumberTexture);
+    }
+    drawIfAny(this->window, &list.cursor, sf::RenderStates::Default);
+    this->drawMinimap(list);
+    this->window.display();
+}
+
+void EditorRenderer::rasterTile(TileCache::Tile &tile, const TileContent &content, const DisplayList &list) {
+    tile.generation = content.generation;
+
+    sf::RenderTexture &atlas = this->tiles.getAtlas();
+    sf::IntRect slot = this->tiles.getSlotRect(tile);
+    sf::Vector2f atlasSize(atlas.getSize());
+
+    sf::View tileView(content.bounds);
+    tileView.setViewport(sf::FloatRect(slot.left / atlasSize.x, slot.top / atlasSize.y,
+        slot.width / atlasSize.x, slot.height / atlasSize.y));
+    atlas.setView(tileView);
+
+    // Wipes whatever tile had the slot before.
+    sf::VertexArray clearSlot(sf::Triangles);
+    appendRect(clearSlot, content.bounds, sf::Color::Transparent);
+    atlas.draw(clearSlot, sf::BlendNone);
+
+    drawIfAny(atlas, &content.background, sf::RenderStates::Default);
+    std::lock_guard<std::mutex> lock(*list.fontMutex);
+    drawIfAny(atlas, &content.text, list.textTexture);
+}
+
+// Block images only go to the GPU when they are new, and the textures of
+// blocks that went out of sight are freed.
+void EditorRenderer::drawMinimap(const DisplayList &list) {
+    for (auto it = this->minimapTextures.begin(); it != this->minimapTextures.end();) {
+        int index = it->first;
+        bool shown = std::any_of(list.minimapBlocks.begin(), list.minimapBlocks.end(),
+            [index](const std::shared_ptr<const MinimapBlock> &block) { return block->index == index; });
+        it = shown ? std::next(it) : this->minimapTextures.erase(it);
+    }
+    if (list.minimapBackground.getVertexCount() == 0) {
+        return;
+    }
+
+    this->window.setView(list.minimapView);
+    drawIfAny(this->window, &list.minimapBackground, sf::RenderStates::Default);
+    for (const std::shared_ptr<const MinimapBlock> &block : list.minimapBlocks) {
+        MinimapTexture &texture = this->minimapTextures[block->index];
+        if (texture.generation != block->generation) {
+            texture.generation = block->generation;
+            texture.texture.loadFromImage(block->image);
+        }
+
+        sf::Vector2u size = block->image.getSize();
+        sf::VertexArray quad(sf::Triangles);
+        appendTexturedRect(quad, sf::FloatRect(0, (float)block->index * size.y, size.x, size.y),
+            sf::IntRect(0, 0, size.x, size.y));
+        this->window.draw(quad, &texture.texture);
+    }
+    drawIfAny(this->window, &list.minimapViewport, sf::RenderStates::Default);
+}
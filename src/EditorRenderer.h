@@ -0,0 +1,64 @@
+#ifndef EditorRenderer_H
+#define EditorRenderer_H
+
+#include <SFML/Graphics.hpp>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "DisplayList.h"
+#include "TileCache.h"
+#include "TripleBuffer.h"
+
+// Draws display lists on a thread of its own, so a slow frame (rastering
+// tiles, waiting for vsync) never holds up input. The UI thread fills
+// getWriteBuffer() and publishes it; the render thread always draws the
+// latest list and skips the ones it had no time for.
+class EditorRenderer {
+   public:
+    EditorRenderer(sf::RenderWindow &window);
+    ~EditorRenderer();
+
+    // The window's OpenGL context moves to the render thread until stop().
+    void start();
+    void stop();
+
+    DisplayList &getWriteBuffer();
+    void publish();
+
+   private:
+    sf::RenderWindow &window;
+    TripleBuffer<DisplayList> displayLists;
+    TileCache tiles;
+
+    std::thread thread;
+    // Only there to sleep until a list is published: lists themselves are
+    // exchanged without locks.
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool framePending;
+    bool stopping;
+
+    // Rebuilt every frame without giving their memory back. Background and
+    // text only hold what didn't fit in the tile cache.
+    sf::VertexArray tileVertices;
+    sf::VertexArray backgroundVertices;
+    sf::VertexArray textVertices;
+
+    struct MinimapTexture {
+        MinimapTexture() : generation(0) {}
+
+        unsigned long long generation;
+        sf::Texture texture;
+    };
+    // Minimap blocks of the last frame, by index.
+    std::map<int, MinimapTexture> minimapTextures;
+
+    void run();
+    void draw(const DisplayList &list);
+    void rasterTile(TileCache::Tile &tile, const TileContent &content, const DisplayList &list);
+    void drawMinimap(const DisplayList &list);
+};
+
+#endif
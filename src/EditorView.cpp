@@ -1,16 +1,43 @@
 #include "EditorView.h"
 
+namespace {
+
+void appendRect(sf::VertexArray &vertices, float x, float y, float width, float height, const sf::Color &color) {
+    sf::Vector2f topLeft(x, y), topRight(x + width, y);
+    sf::Vector2f bottomLeft(x, y + height), bottomRight(x + width, y + height);
+
+    vertices.append(sf::Vertex(topLeft, color));
+    vertices.append(sf::Vertex(topRight, color));
+    vertices.append(sf::Vertex(bottomLeft, color));
+    vertices.append(sf::Vertex(bottomLeft, color));
+    vertices.append(sf::Vertex(topRight, color));
+    vertices.append(sf::Vertex(bottomRight, color));
+}
+
+}  // namespace
+
+// Built tiles are kept while they are few; past this, the ones out of sight
+// are dropped.
+constexpr std::size_t TILE_CONTENTS_LIMIT = 256;
+
 EditorView::EditorView(
     const sf::RenderWindow &window,
     const sf::String &workingDirectory,
     EditorContent &editorContent)
     : content(editorContent),
       camera(sf::FloatRect(-50, 0, window.getSize().x, window.getSize().y)),
+      viewport(0, 0, 1, 1),
       deltaScroll(20), deltaRotation(2), deltaZoomIn(0.8f), deltaZoomOut(1.2f) {
     this->font.loadFromFile(workingDirectory + "fonts/DejaVuSansMono.ttf");
 
-    this->bottomLimitPx = 1;
-    this->rightLimitPx = 1;
+    this->nextGeneration = 1;
+    this->gutterFirstLine = 0;
+    this->gutterLastLine = -1;
+    this->gutterVisible = false;
+    this->gutterStale = true;
+    this->frameStale = true;
+    this->drawnCursorVersion = 0;
+
 
     this->setFontSize(18);  
 
@@ -24,20 +51,30 @@ EditorView::EditorView(
 void EditorView::setFontSize(int fontSize) {
     this->fontSize = fontSize;
     this->lineHeight = fontSize;
-    sf::Text tmpText;
-    tmpText.setFont(this->font);
-    tmpText.setCharacterSize(this->fontSize);
-    tmpText.setString("_");
-    float textwidth = tmpText.getLocalBounds().width;
-    this->charWidth = textwidth;
+    {
+        std::lock_guard<std::mutex> lock(this->fontMutex);
+        sf::Text tmpText;
+        tmpText.setFont(this->font);
+        tmpText.setCharacterSize(this->fontSize);
+        tmpText.setString("_");
+        float textwidth = tmpText.getLocalBounds().width;
+        this->charWidth = textwidth;
+    }
+
+    this->textGlyphs.setFont(this->font, this->fontSize, this->fontMutex);
+    this->lineNumberGlyphs.setFont(this->font, this->fontSize - 1, this->fontMutex);
+
+    this->tileContents.clear();
+    this->gutterStale = true;
+    this->frameStale = true;
 }
 
 float EditorView::getRightLimitPx() {
-    return this->rightLimitPx;
+    return this->charWidth * this->content.longestLineWidth();
 }
 
 float EditorView::getBottomLimitPx() {
-    return this->bottomLimitPx;
+    return this->content.linesCount() * this->lineHeight;
 }
 
 int EditorView::getLineHeight() {
@@ -48,104 +85,252 @@ int EditorView::getCharWidth() {
     return this->charWidth;
 }
 
-void EditorView::draw(sf::RenderWindow &window) {
-    this->drawLines(window);
+// Only the lines and columns the camera can see go in the list, so a frame
+// costs the same whatever the size of the document. Text is cut in tiles
+// that are rebuilt only when their lines change; the render thread keeps
+// them rastered, so frames where nothing was edited just composite textures.
+void EditorView::buildDisplayList(DisplayList &list) {
+    this->frameStale = false;
+    this->drawnCamera = this->camera;
+    this->drawnCursorVersion = this->content.getCursorVersion();
+
+    sf::FloatRect area = this->getVisibleArea();
+    int firstLine, lastLine;
+    this->getVisibleLines(area, firstLine, lastLine);
+
+    DirtyLines &changedLines = this->content.getChangedLines();
+    if (!changedLines.isEmpty()) {
+        this->invalidateTiles(changedLines);
+        changedLines.clear();
+        this->gutterStale = true;
+    }
 
-    for (int lineNumber = 1; lineNumber <= this->content.linesCount(); lineNumber++) {
-        int lineHeight = 1;
+    list.camera = this->camera;
+    list.tileSize = sf::Vector2i(this->charWidth * TileCache::TILE_COLUMNS, this->lineHeight * TileCache::TILE_LINES);
+    this->appendTiles(list, area, firstLine, lastLine);
 
-        int blockHeight = lineHeight * this->fontSize;
+    this->updateGutter(firstLine, lastLine, area.left < 0);
+    list.margin = this->marginVertices;
+    list.lineNumbers = this->lineNumberVertices;
 
-        sf::Text lineNumberText;
-        lineNumberText.setFillColor(sf::Color::White);
-        lineNumberText.setFont(this->font);
-        lineNumberText.setString(std::to_string(lineNumber));
-        lineNumberText.setCharacterSize(this->fontSize - 1);
-        lineNumberText.setPosition(-this->marginXOffset, blockHeight * (lineNumber - 1));
+    list.cursor.clear();
+    this->appendCursors(list.cursor, firstLine, lastLine);
+
+    list.textTexture = &this->textGlyphs.getTexture();
+    list.lineNumberTexture = &this->lineNumberGlyphs.getTexture();
+    list.fontMutex = &this->fontMutex;
+}
 
-        sf::RectangleShape marginRect(sf::Vector2f(this->marginXOffset - 5, blockHeight));
-        marginRect.setFillColor(this->colorMargin);
-        marginRect.setPosition(-this->marginXOffset, blockHeight * (lineNumber - 1));
+bool EditorView::needsRedraw() {
+    return this->frameStale || !this->content.getChangedLines().isEmpty() ||
+           this->content.getCursorVersion() != this->drawnCursorVersion ||
+           this->camera.getCenter() != this->drawnCamera.getCenter() ||
+           this->camera.getSize() != this->drawnCamera.getSize() ||
+           this->camera.getRotation() != this->drawnCamera.getRotation();
+}
 
-        window.draw(marginRect);
-        window.draw(lineNumberText);
+// Bounding box, in document coordinates, of what the camera shows. With a
+// rotated camera it also covers the corners that fall outside the window.
+sf::FloatRect EditorView::getVisibleArea() const {
+    const sf::Transform &toDocument = this->camera.getInverseTransform();
+    sf::Vector2f corners[4] = {
+        toDocument.transformPoint(-1, -1),
+        toDocument.transformPoint(1, -1),
+        toDocument.transformPoint(1, 1),
+        toDocument.transformPoint(-1, 1)};
+
+    float left = corners[0].x, right = corners[0].x;
+    float top = corners[0].y, bottom = corners[0].y;
+    for (const sf::Vector2f &corner : corners) {
+        left = std::min(left, corner.x);
+        right = std::max(right, corner.x);
+        top = std::min(top, corner.y);
+        bottom = std::max(bottom, corner.y);
     }
+    return sf::FloatRect(left, top, right - left, bottom - top);
+}
 
-    this->drawCursor(window);
+// lastLine < firstLine when no line is in sight.
+void EditorView::getVisibleLines(const sf::FloatRect &area, int &firstLine, int &lastLine) {
+    int lastDocumentLine = this->content.linesCount() - 1;
+    firstLine = std::max(0, (int)std::floor(area.top / this->lineHeight));
+    lastLine = std::min(lastDocumentLine, (int)std::floor((area.top + area.height) / this->lineHeight));
 }
 
-int colsOf(sf::String &currentLineText) {
-    int cols = 0;
-    for (char c : currentLineText) {
-        if (c == '\t') {
-            cols += 4;
-        } else {
-            cols++;
+void EditorView::updateGutter(int firstLine, int lastLine, bool marginVisible) {
+    if (!this->gutterStale && firstLine == this->gutterFirstLine && lastLine == this->gutterLastLine &&
+        marginVisible == this->gutterVisible) {
+        return;
+    }
+    this->gutterStale = false;
+    this->gutterFirstLine = firstLine;
+    this->gutterLastLine = lastLine;
+    this->gutterVisible = marginVisible;
+
+    // New arrays every time: the render thread may still be drawing the old ones.
+    auto margin = std::make_shared<sf::VertexArray>(sf::Triangles);
+    auto lineNumbers = std::make_shared<sf::VertexArray>(sf::Triangles);
+    if (marginVisible) {
+        for (int lineNumber = firstLine + 1; lineNumber <= lastLine + 1; lineNumber++) {
+            int lineHeight = 1;
+
+            int blockHeight = lineHeight * this->fontSize;
+            float y = blockHeight * (lineNumber - 1);
+
+            appendRect(*margin, -this->marginXOffset, y,
+                this->marginXOffset - 5, blockHeight, this->colorMargin);
+
+            float x = -this->marginXOffset;
+            for (char digit : std::to_string(lineNumber)) {
+                this->lineNumberGlyphs.appendGlyph(*lineNumbers, digit, x, y, sf::Color::White);
+                x += this->lineNumberGlyphs.getAdvance(digit);
+            }
         }
     }
-    return cols;
+    this->marginVertices = margin;
+    this->lineNumberVertices = lineNumbers;
 }
 
-void EditorView::drawLines(sf::RenderWindow &window) {
-    this->bottomLimitPx = this->content.linesCount() * this->fontSize;
+// Tiles in sight go in the list, building the ones that changed since the
+// last list. Tiles with nothing to draw are left out.
+void EditorView::appendTiles(DisplayList &list, const sf::FloatRect &area, int firstLine, int lastLine) {
+    list.tiles.clear();
+    if (lastLine < firstLine || this->charWidth <= 0) {
+        return;
+    }
 
-    for (int lineNumber = 0; lineNumber < this->content.linesCount(); lineNumber++) {
-        sf::String line = this->content.getLine(lineNumber);
-        sf::String currentLineText = "";
-        this->rightLimitPx = std::max((int)this->rightLimitPx, (int)(this->charWidth * line.getSize()));
+    float tileWidth = this->charWidth * TileCache::TILE_COLUMNS;
+    int firstRow = firstLine / TileCache::TILE_LINES;
+    int lastRow = lastLine / TileCache::TILE_LINES;
+    int firstTileColumn = std::max(0, (int)std::floor(area.left / tileWidth));
+    int lastTileColumn = std::max(0, (int)std::floor((area.left + area.width) / tileWidth));
+
+    if (this->tileContents.size() > TILE_CONTENTS_LIMIT) {
+        for (auto it = this->tileContents.begin(); it != this->tileContents.end();) {
+            int row = it->first.first, column = it->first.second;
+            bool inSight = row >= firstRow && row <= lastRow && column >= firstTileColumn && column <= lastTileColumn;
+            it = inSight ? std::next(it) : this->tileContents.erase(it);
+        }
+    }
 
-        float offsetx = 0;
-        bool previousSelected = false;
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstTileColumn; column <= lastTileColumn; column++) {
+            std::pair<int, int> key(row, column);
+            auto it = this->tileContents.find(key);
+            if (it == this->tileContents.end()) {
+                it = this->tileContents.emplace(key, this->buildTile(row, column)).first;
+            }
+            if (it->second) {
+                list.tiles.push_back(it->second);
+            }
+        }
+    }
+}
 
-        for (int charIndexInLine = 0; charIndexInLine <= (int)line.getSize(); charIndexInLine++) {
-            bool currentSelected = content.isSelected(lineNumber, charIndexInLine);
-            if (currentSelected != previousSelected || charIndexInLine == (int)line.getSize()) {
-                sf::Text texto;
-                texto.setFillColor(this->colorChar);
-                texto.setFont(font);
-                texto.setString(currentLineText);
-                texto.setCharacterSize(this->fontSize);
-                texto.setPosition(offsetx, lineNumber * this->fontSize);
+// A tile also shows the bits of the lines around it that reach into it, so
+// it goes stale when those change too.
+void EditorView::invalidateTiles(const DirtyLines &lines) {
+    for (auto it = this->tileContents.begin(); it != this->tileContents.end();) {
+        int firstLine = it->first.first * TileCache::TILE_LINES;
+        int lastLine = firstLine + TileCache::TILE_LINES - 1;
+        if (lines.intersects(firstLine - 1, lastLine + 1)) {
+            it = this->tileContents.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
 
-                if (previousSelected) {
-                    int currentColsAmount = colsOf(currentLineText);
-                    sf::RectangleShape selectionRect(
-                        sf::Vector2f(this->charWidth * currentColsAmount, this->fontSize));
-                    selectionRect.setFillColor(this->colorSelection);
-                    selectionRect.setPosition(offsetx, 2 + lineNumber * this->fontSize);
-                    window.draw(selectionRect);
-                }
+std::shared_ptr<const TileContent> EditorView::buildTile(int row, int column) {
+    int lastDocumentLine = this->content.linesCount() - 1;
+    int firstLine = row * TileCache::TILE_LINES;
+    int lastLine = std::min(firstLine + TileCache::TILE_LINES - 1, lastDocumentLine);
+    int firstColumn = column * TileCache::TILE_COLUMNS;
+    int endColumn = firstColumn + TileCache::TILE_COLUMNS;
+
+    auto tile = std::make_shared<TileContent>();
+    this->appendLines(firstLine, lastLine, firstColumn, endColumn, tile->background, tile->text);
+    tile->ownBackgroundCount = tile->background.getVertexCount();
+    tile->ownTextCount = tile->text.getVertexCount();
+    if (firstLine > 0) {
+        this->appendLines(firstLine - 1, firstLine - 1, firstColumn, endColumn, tile->background, tile->text);
+    }
+    if (lastLine < lastDocumentLine) {
+        this->appendLines(lastLine + 1, lastLine + 1, firstColumn, endColumn, tile->background, tile->text);
+    }
+    if (tile->background.getVertexCount() == 0 && tile->text.getVertexCount() == 0) {
+        return nullptr;
+    }
 
-                window.draw(texto);
+    tile->row = row;
+    tile->column = column;
+    tile->bounds = sf::FloatRect(this->charWidth * firstColumn, this->lineHeight * firstLine,
+        this->charWidth * TileCache::TILE_COLUMNS, this->lineHeight * TileCache::TILE_LINES);
+    tile->generation = this->nextGeneration++;
+    return tile;
+}
 
-                previousSelected = currentSelected;
-                offsetx += this->charWidth * colsOf(currentLineText);
-                currentLineText = "";
+// Glyphs are laid on the column grid, so text, selections and the cursor
+// always line up. Only columns in [firstColumn, endColumn) are fetched and
+// appended, so a tile far into a very long line costs the same as the first.
+void EditorView::appendLines(int firstLine, int lastLine, int firstColumn, int endColumn,
+    sf::VertexArray &background, sf::VertexArray &text) {
+    int tabWidth = this->content.getTabWidth();
+    std::vector<SelectionData::Span> spans;
+    this->content.getSelectedSpans(firstLine, lastLine, spans);
+    auto span = spans.begin();
+
+    for (int lineNumber = firstLine; lineNumber <= lastLine; lineNumber++) {
+        float y = lineNumber * this->fontSize;
+
+        for (; span != spans.end() && span->lineN == lineNumber; ++span) {
+            int selectionStart = std::max(this->content.getColumnFromCharN(lineNumber, span->startChar), firstColumn);
+            int selectionEnd = std::min(this->content.getColumnFromCharN(lineNumber, span->endChar), endColumn);
+            if (selectionStart < selectionEnd) {
+                appendRect(background, this->charWidth * selectionStart, 2 + y,
+                    this->charWidth * (selectionEnd - selectionStart), this->fontSize, this->colorSelection);
             }
-            currentLineText += line[charIndexInLine];
+        }
+
+        int column, endCharColumn;
+        int firstChar = this->content.getCharAtColumn(lineNumber, firstColumn, column);
+        // Marks that combine with the last character before endColumn start
+        // at endColumn, and come before the character drawn over it.
+        int endChar = this->content.getCharAtColumn(lineNumber, endColumn, endCharColumn);
+        if (endCharColumn < endColumn) {
+            endChar++;
+        }
+        int amount = endChar - firstChar;
+        if (amount <= 0) {
+            continue;
+        }
+        sf::String line = this->content.getLineSlice(lineNumber, firstChar, amount);
+
+        // A wide character across the tile edge is drawn by both tiles,
+        // each keeping its own half.
+        for (sf::Uint32 c : line) {
+            this->textGlyphs.appendGlyph(text, c, this->charWidth * column, y, this->colorChar);
+            column += ColumnWidth::of(c, tabWidth);
         }
     }
 }
 
-void EditorView::drawCursor(sf::RenderWindow &window) {
+void EditorView::appendCursors(sf::VertexArray &cursor, int firstLine, int lastLine) {
     int offsetY = 2;
     int cursorDrawWidth = 2;
 
     int charWidth = getCharWidth();
     int lineHeight = getLineHeight();
 
-    std::pair<int, int> cursorPos = this->content.cursorPosition();
-    int lineN = cursorPos.first;
-    int column = cursorPos.second;
-
-    sf::RectangleShape cursorRect(sf::Vector2f(cursorDrawWidth, lineHeight));
-    cursorRect.setFillColor(sf::Color::White);
-
-    cursorRect.setPosition(
-        column * charWidth,
-        (lineN * lineHeight) + offsetY);
+    this->cursorPositions.clear();
+    this->content.getCursorsInLines(firstLine, lastLine, this->cursorPositions);
+    for (const std::pair<int, int> &cursorPos : this->cursorPositions) {
+        int lineN = cursorPos.first;
+        int column = cursorPos.second;
 
-    window.draw(cursorRect);
+        appendRect(cursor, column * charWidth, (lineN * lineHeight) + offsetY,
+            cursorDrawWidth, lineHeight, sf::Color::White);
+    }
 }
 
 std::pair<int, int> EditorView::getDocumentCoords(
@@ -161,29 +346,33 @@ std::pair<int, int> EditorView::getDocumentCoords(
         charN = 0;
     } else if (lineN > lastLine) {
         lineN = lastLine;
-        charN = this->content.colsInLine(lineN);
+        charN = this->content.charsInLine(lineN);
     } else {
         lineN = std::max(lineN, 0);
         lineN = std::min(lineN, lastLine);
         int column = std::round(mouseX / this->getCharWidth());
         charN = this->content.getCharIndexOfColumn(lineN, column);
         charN = std::max(charN, 0);
-        charN = std::min(charN, this->content.colsInLine(lineN));
+        charN = std::min(charN, this->content.charsInLine(lineN));
     }
 
     return std::pair<int, int>(lineN, charN);
 }
 
-void EditorView::scrollUp(sf::RenderWindow &window) {
-    float height = window.getView().getSize().y;
+void EditorView::scrollTo(float x, float y) {
+    this->camera.setCenter(x, y);
+}
+
+void EditorView::scrollUp() {
+    float height = this->camera.getSize().y;
     auto camPos = this->camera.getCenter();
     if (camPos.y - height / 2 > 0) {
         this->camera.move(0, -this->deltaScroll);
     }
 }
 
-void EditorView::scrollDown(sf::RenderWindow &window) {
-    float height = window.getView().getSize().y;
+void EditorView::scrollDown() {
+    float height = this->camera.getSize().y;
     float bottomLimit = std::max(this->getBottomLimitPx(), height);
     auto camPos = this->camera.getCenter();
     if (camPos.y + height / 2 < bottomLimit + 20) {
@@ -191,16 +380,16 @@ void EditorView::scrollDown(sf::RenderWindow &window) {
     }
 }
 
-void EditorView::scrollLeft(sf::RenderWindow &window) {
-    float width = window.getView().getSize().x;
+void EditorView::scrollLeft() {
+    float width = this->camera.getSize().x;
     auto camPos = this->camera.getCenter();
     if (camPos.x - width / 2 > -this->marginXOffset) {
         this->camera.move(-this->deltaScroll, 0);
     }
 }
 
-void EditorView::scrollRight(sf::RenderWindow &window) {
-    float width = window.getView().getSize().x;
+void EditorView::scrollRight() {
+    float width = this->camera.getSize().x;
     float rightLimit = std::max(this->getRightLimitPx(), width);
     auto camPos = this->camera.getCenter();
     if (camPos.x + width / 2 < rightLimit + 20) {
@@ -226,6 +415,14 @@ void EditorView::zoomOut() {
 
 void EditorView::setCameraBounds(int width, int height) {
     this->camera = sf::View(sf::FloatRect(-50, 0, width, height));
+    this->camera.setViewport(this->viewport);
+    this->frameStale = true;
+}
+
+void EditorView::setViewport(const sf::FloatRect &viewport) {
+    this->viewport = viewport;
+    this->camera.setViewport(viewport);
+    this->frameStale = true;
 }
 
 sf::View EditorView::getCameraView() {
@@ -3,7 +3,14 @@
 
 #include <SFML/Graphics.hpp>
 #include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "ColumnWidth.h"
+#include "DisplayList.h"
 #include "EditorContent.h"
+#include "GlyphAtlas.h"
+#include "TileCache.h"
 
 class EditorView {
    public:
@@ -11,14 +18,19 @@ class EditorView {
         const sf::String &workingDirectory,
         EditorContent &editorContent);
 
-    void draw(sf::RenderWindow &window);
+    // Fills `list` with what the camera sees, for EditorRenderer to draw.
+    void buildDisplayList(DisplayList &list);
+    // True when the last display list built no longer shows the current text,
+    // selections, cursor or camera.
+    bool needsRedraw();
     void setFontSize(int fontSize);
 
-    void scrollUp(sf::RenderWindow &window);
-    void scrollDown(sf::RenderWindow &window);
-    void scrollLeft(sf::RenderWindow &window);
-    void scrollRight(sf::RenderWindow &window);
+    void scrollUp();
+    void scrollDown();
+    void scrollLeft();
+    void scrollRight();
 
+    // Centers the camera on (x, y), in document coordinates.
     void scrollTo(float x, float y);
 
     void rotateLeft();
@@ -35,6 +47,8 @@ class EditorView {
 
     sf::View getCameraView();
     void setCameraBounds(int width, int height);
+    // Part of the window the camera draws to, as in sf::View::setViewport.
+    void setViewport(const sf::FloatRect &viewport);
 
     void setDeltaScroll(float delta);
     void setDeltaRotation(float delta);
@@ -45,10 +59,23 @@ class EditorView {
    private:
     EditorContent &content;
 
-    void drawLines(sf::RenderWindow &window);
-    void drawCursor(sf::RenderWindow &window);
+    void appendTiles(DisplayList &list, const sf::FloatRect &area, int firstLine, int lastLine);
+    void invalidateTiles(const DirtyLines &lines);
+    std::shared_ptr<const TileContent> buildTile(int row, int column);
+    void appendLines(int firstLine, int lastLine, int firstColumn, int endColumn,
+        sf::VertexArray &background, sf::VertexArray &text);
+    void updateGutter(int firstLine, int lastLine, bool marginVisible);
+    // Only the cursors on the lines in sight.
+    void appendCursors(sf::VertexArray &cursor, int firstLine, int lastLine);
+
+    sf::FloatRect getVisibleArea() const;
+    void getVisibleLines(const sf::FloatRect &area, int &firstLine, int &lastLine);
 
     sf::Font font;
+    // Held whenever the font texture is read or changed, by either thread.
+    std::mutex fontMutex;
+    GlyphAtlas textGlyphs;
+    GlyphAtlas lineNumberGlyphs;
     int fontSize;
     int marginXOffset;
     sf::Color colorMargin;
@@ -56,13 +83,28 @@ class EditorView {
     int lineHeight;
     int charWidth;
 
-    float rightLimitPx;
-    float bottomLimitPx;
-
     sf::Color colorChar;
     sf::Color colorSelection;
 
+    // Tiles built for earlier lists, shared with the ones the render thread
+    // may still be drawing. nullptr for tiles with nothing to draw.
+    std::map<std::pair<int, int>, std::shared_ptr<const TileContent>> tileContents;
+    unsigned long long nextGeneration;
+
+    // Line numbers, rebuilt when the visible lines change.
+    std::shared_ptr<const sf::VertexArray> marginVertices;
+    std::shared_ptr<const sf::VertexArray> lineNumberVertices;
+    int gutterFirstLine;
+    int gutterLastLine;
+    bool gutterVisible;
+    bool gutterStale;
+
     sf::View camera;
+    sf::FloatRect viewport;
+    sf::View drawnCamera;
+    unsigned long long drawnCursorVersion;
+    std::vector<std::pair<int, int>> cursorPositions;
+    bool frameStale;
     float deltaScroll;
     float deltaRotation;
     float deltaZoomIn, deltaZoomOut;
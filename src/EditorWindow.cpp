@@ -0,0 +1,83 @@
+#include "EditorWindow.h"
+
+#include <algorithm>
+
+EditorWindow::EditorWindow(std::string filename, const sf::String &workingDirectory)
+    : window(sf::VideoMode(1200, 800), "Text Editor"),
+      filename(filename),
+      content(document),
+      view(window, workingDirectory, content),
+      minimap(document),
+      renderer(window),
+      input(content) {
+    this->window.setVerticalSyncEnabled(true);
+    this->document.init(this->filename);
+    this->layout(this->window.getSize().x, this->window.getSize().y);
+}
+
+void EditorWindow::run() {
+    this->renderer.start();
+    while (this->window.isOpen()) {
+        sf::Event event;
+        while (this->scheduler.nextEvent(this->window, event)) {
+            this->handleEvent(event);
+            this->updateSchedule();
+        }
+        if (!this->window.isOpen()) {
+            break;
+        }
+
+        this->input.handleConstantInput(this->view, this->window);
+        this->updateSchedule();
+
+        if (this->scheduler.shouldDraw()) {
+            this->drawFrame();
+        }
+    }
+}
+
+void EditorWindow::layout(unsigned width, unsigned height) {
+    int minimapWidth = std::min(+Minimap::WIDTH, (int)width / 2);
+    int editorWidth = std::max(1, (int)width - minimapWidth);
+    this->view.setCameraBounds(editorWidth, height);
+    this->view.setViewport(sf::FloatRect(0, 0, (float)editorWidth / std::max(1u, width), 1));
+    this->minimap.setArea(sf::IntRect(editorWidth, 0, minimapWidth, height), sf::Vector2u(width, height));
+}
+
+void EditorWindow::handleEvent(sf::Event &event) {
+    if (event.type == sf::Event::Closed) {
+        this->renderer.stop();
+        this->window.close();
+        return;
+    }
+    if (event.type == sf::Event::Resized) {
+        this->layout(event.size.width, event.size.height);
+    }
+    // Clicking the minimap brings the line under the mouse to the middle of
+    // the editor.
+    if (event.type == sf::Event::MouseButtonPressed &&
+        this->minimap.contains(event.mouseButton.x, event.mouseButton.y)) {
+        int line = this->minimap.lineAt(event.mouseButton.y);
+        float lineHeight = this->view.getLineHeight();
+        this->view.scrollTo(this->view.getCameraView().getCenter().x, (line + 0.5f) * lineHeight);
+        return;
+    }
+    this->input.handleEvents(this->view, this->window, event);
+}
+
+void EditorWindow::updateSchedule() {
+    if (this->view.needsRedraw() || this->minimap.needsRedraw()) {
+        this->scheduler.requestFrame();
+    }
+    // Ticks while minimap blocks are drawn in the background, to pick them
+    // up as they finish.
+    this->scheduler.setAnimating(this->input.isAnimating() || this->minimap.isBuilding());
+}
+
+void EditorWindow::drawFrame() {
+    DisplayList &list = this->renderer.getWriteBuffer();
+    this->view.buildDisplayList(list);
+    this->minimap.buildDisplayList(list, this->view);
+    this->renderer.publish();
+    this->scheduler.frameDrawn();
+}
@@ -0,0 +1,41 @@
+#ifndef EditorWindow_H
+#define EditorWindow_H
+
+#include <SFML/Graphics.hpp>
+#include <string>
+
+#include "EditorContent.h"
+#include "EditorRenderer.h"
+#include "EditorView.h"
+#include "InputController.h"
+#include "Minimap.h"
+#include "RenderScheduler.h"
+#include "TextDocument.h"
+
+// SFML window editing one document: owns the editor parts and runs the
+// event loop. The minimap takes a strip at the right of the window. When the RenderScheduler says so it builds a display list and
+// hands it to the EditorRenderer, which draws it on its own thread.
+class EditorWindow {
+   public:
+    EditorWindow(std::string filename, const sf::String &workingDirectory);
+
+    void run();
+
+   private:
+    sf::RenderWindow window;
+    std::string filename;
+    TextDocument document;
+    EditorContent content;
+    EditorView view;
+    Minimap minimap;
+    EditorRenderer renderer;
+    InputController input;
+    RenderScheduler scheduler;
+
+    void layout(unsigned width, unsigned height);
+    void handleEvent(sf::Event &event);
+    void updateSchedule();
+    void drawFrame();
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "GlyphAtlas.h"
+
+// Same margin sf::Text leaves around each glyph, so smoothing at the edges of
+// the texture rectangle isn't cut off.
+constexpr float GLYPH_PADDING = 1;
+
+GlyphAtlas::GlyphAtlas() : font(nullptr), texture(nullptr), fontMutex(nullptr), characterSize(0) {}
+
+void GlyphAtlas::setFont(const sf::Font &font, unsigned characterSize, std::mutex &fontMutex) {
+    std::lock_guard<std::mutex> lock(fontMutex);
+    this->font = &font;
+    this->fontMutex = &fontMutex;
+    this->characterSize = characterSize;
+    this->texture = &font.getTexture(characterSize);
+
+    this->otherGlyphs.clear();
+    this->asciiGlyphs.clear();
+    for (sf::Uint32 c = 0; c < ASCII_GLYPHS; c++) {
+        this->asciiGlyphs.push_back(font.getGlyph(c, characterSize, false));
+    }
+}
+
+unsigned GlyphAtlas::getCharacterSize() const {
+    return this->characterSize;
+}
+
+const sf::Texture &GlyphAtlas::getTexture() const {
+    return *this->texture;
+}
+
+void GlyphAtlas::appendGlyph(sf::VertexArray &vertices, sf::Uint32 c, float x, float y, const sf::Color &color) {
+    const sf::Glyph &glyph = this->glyphOf(c);
+    if (glyph.textureRect.width == 0 || glyph.textureRect.height == 0) {
+        return;
+    }
+
+    float baseline = y + this->characterSize;
+    float left = x + glyph.bounds.left - GLYPH_PADDING;
+    float top = baseline + glyph.bounds.top - GLYPH_PADDING;
+    float right = x + glyph.bounds.left + glyph.bounds.width + GLYPH_PADDING;
+    float bottom = baseline + glyph.bounds.top + glyph.bounds.height + GLYPH_PADDING;
+
+    float u1 = glyph.textureRect.left - GLYPH_PADDING;
+    float v1 = glyph.textureRect.top - GLYPH_PADDING;
+    float u2 = glyph.textureRect.left + glyph.textureRect.width + GLYPH_PADDING;
+    float v2 = glyph.textureRect.top + glyph.textureRect.height + GLYPH_PADDING;
+
+    vertices.append(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u1, v1)));
+    vertices.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+    vertices.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+    vertices.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+    vertices.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+    vertices.append(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u2, v2)));
+}
+
+float GlyphAtlas::getAdvance(sf::Uint32 c) {
+    return this->glyphOf(c).advance;
+}
+
+// sf::Font loads a glyph into its texture the first time it is asked for, so
+// a character outside ASCII costs one font lookup per atlas.
+const sf::Glyph &GlyphAtlas::glyphOf(sf::Uint32 c) {
+    if (c < ASCII_GLYPHS) {
+        return this->asciiGlyphs[c];
+    }
+
+    auto it = this->otherGlyphs.find(c);
+    if (it == this->otherGlyphs.end()) {
+        std::lock_guard<std::mutex> lock(*this->fontMutex);
+        it = this->otherGlyphs.emplace(c, this->font->getGlyph(c, this->characterSize, false)).first;
+    }
+    return it->second;
+}
@@ -0,0 +1,42 @@
+#ifndef GlyphAtlas_H
+#define GlyphAtlas_H
+
+#include <SFML/Graphics.hpp>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Glyph metrics and texture rectangles of one font at one character size,
+// looked up once and then reused to write text straight into vertex arrays.
+// Everything appended through the same atlas is drawn with getTexture().
+//
+// Loading a glyph changes the font texture, which the render thread may be
+// drawing with, so the font is only touched with fontMutex held.
+class GlyphAtlas {
+   public:
+    GlyphAtlas();
+
+    void setFont(const sf::Font &font, unsigned characterSize, std::mutex &fontMutex);
+    unsigned getCharacterSize() const;
+    const sf::Texture &getTexture() const;
+
+    // Appends two triangles drawing `c` with the top of its line at (x, y).
+    // Characters with nothing to draw (spaces, tabs) append nothing.
+    void appendGlyph(sf::VertexArray &vertices, sf::Uint32 c, float x, float y, const sf::Color &color);
+    float getAdvance(sf::Uint32 c);
+
+    static const int ASCII_GLYPHS = 128;
+
+   private:
+    const sf::Font *font;
+    const sf::Texture *texture;
+    std::mutex *fontMutex;
+    unsigned characterSize;
+
+    std::vector<sf::Glyph> asciiGlyphs;
+    std::unordered_map<sf::Uint32, sf::Glyph> otherGlyphs;
+
+    const sf::Glyph &glyphOf(sf::Uint32 c);
+};
+
+#endif
@@ -32,25 +32,25 @@ void InputController::handleConstantInput(EditorView &textView,
 
     if (this->isMouseDown()) {
         auto mousepos = sf::Mouse::getPosition(window);
-        auto mousepos_text = window.mapPixelToCoords(mousepos);
+        auto mousepos_text = window.mapPixelToCoords(mousepos, textView.getCameraView());
 
         updateCursorInEditor(textView, mousepos_text.x, mousepos_text.y);
 
         float textViewTop = 0;
-        float textViewBottom = window.getView().getSize().y - 5;
+        float textViewBottom = textView.getCameraView().getSize().y - 5;
         float textViewLeft = 0;
-        float textViewRight = window.getView().getSize().x;
+        float textViewRight = textView.getCameraView().getSize().x;
 
         if (mousepos.x < textViewLeft) {
-            textView.scrollLeft(window);
+            textView.scrollLeft();
         } else if (mousepos.x > textViewRight) {
-            textView.scrollRight(window);
+            textView.scrollRight();
         }
 
         if (mousepos.y < textViewTop) {
-            textView.scrollUp(window);
+            textView.scrollUp();
         } else if (mousepos.y > textViewBottom) {
-            textView.scrollDown(window);
+            textView.scrollDown();
         }
     }
 }
@@ -63,25 +63,30 @@ void InputController::handleMouseEvents(
     if (event.type == sf::Event::MouseWheelScrolled) {
         if (event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel) {
             if (event.mouseWheelScroll.delta > 0) {
-                textView.scrollUp(window);
+                textView.scrollUp();
             } else {
-                textView.scrollDown(window);
+                textView.scrollDown();
             }
         } else if (event.mouseWheelScroll.wheel == sf::Mouse::HorizontalWheel) {
             if (event.mouseWheelScroll.delta > 0) {
-                textView.scrollLeft(window);
+                textView.scrollLeft();
             } else {
-                textView.scrollRight(window);
+                textView.scrollRight();
             }
         }
     }
     if (event.type == sf::Event::MouseButtonPressed) {
-        this->editorContent.removeSelections();
+        bool isCtrlPressed = sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) || sf::Keyboard::isKeyPressed(sf::Keyboard::RControl);
         auto mousepos = sf::Mouse::getPosition(window);
-        auto mousepos_text = window.mapPixelToCoords(mousepos);
+        auto mousepos_text = window.mapPixelToCoords(mousepos, textView.getCameraView());
 
         std::pair<int, int> docCoords = textView.getDocumentCoords(mousepos_text.x, mousepos_text.y);
-        this->editorContent.createNewSelection(docCoords.first, docCoords.second);
+        // Ctrl+click adds a cursor, a plain click leaves only the new one
+        if (isCtrlPressed) {
+            this->editorContent.addCursor(docCoords.first, docCoords.second);
+        } else {
+            this->editorContent.resetCursor(docCoords.first, docCoords.second);
+        }
 
         this->mouseDown = true;
     }
@@ -106,11 +111,15 @@ void InputController::handleKeyPressedEvents(EditorView &textView, sf::Event &ev
                 this->shiftPressed = true;
              
                 this->editorContent.removeSelections();
-                this->editorContent.createNewSelectionFromCursor();
                 return;
             }
         }
 
+        if (event.key.code == sf::Keyboard::Escape) {
+            editorContent.keepPrimaryCursor();
+            return;
+        }
+
         if (isEndPressed) {
             editorContent.moveCursorToEnd(isShiftPressed);
             return;
@@ -125,7 +134,6 @@ void InputController::handleKeyPressedEvents(EditorView &textView, sf::Event &ev
             if (event.key.code == sf::Keyboard::D) {
                 editorContent.duplicateCursorLine();
             } else if (event.key.code == sf::Keyboard::U) {
-                editorContent.deleteSelections();
                 sf::String emoji = "\\_('-')_/";
                 editorContent.addTextInCursorPos(emoji);
             } else if (event.key.code == sf::Keyboard::C) { 
@@ -138,13 +146,25 @@ void InputController::handleKeyPressedEvents(EditorView &textView, sf::Event &ev
             } else if (event.key.code == sf::Keyboard::X) {  
                 this->stringCopied = editorContent.copySelections();
                 editorContent.deleteSelections();
+            } else if (event.key.code == sf::Keyboard::Z) {
+                if (isShiftPressed) {
+                    editorContent.redo();
+                } else {
+                    editorContent.undo();
+                }
+            } else if (event.key.code == sf::Keyboard::Y) {
+                editorContent.redo();
+            } else if (event.key.code == sf::Keyboard::L && isShiftPressed) {
+                editorContent.selectAllOccurrences();
             }
         }
 
         if (event.key.code == sf::Keyboard::Up) {
-            if (ctrlAndShift) {
+            if (isCtrlPressed && event.key.alt) {
+                editorContent.addCursorsVertically(true);
+                return;
+            } else if (ctrlAndShift) {
                 editorContent.swapSelectedLines(true);
-                editorContent.moveCursorUp(true);
                 return;
             } else {
                 editorContent.moveCursorUp(this->shiftPressed);
@@ -152,9 +172,11 @@ void InputController::handleKeyPressedEvents(EditorView &textView, sf::Event &ev
             }
         }
         if (event.key.code == sf::Keyboard::Down) {
-            if (ctrlAndShift) {
+            if (isCtrlPressed && event.key.alt) {
+                editorContent.addCursorsVertically(false);
+                return;
+            } else if (ctrlAndShift) {
                 editorContent.swapSelectedLines(false);
-                editorContent.moveCursorDown(true);
                 return;
             } else {
                 editorContent.moveCursorDown(this->shiftPressed);
@@ -197,21 +219,14 @@ void InputController::handleTextEnteredEvent(sf::Event &event) {
         sf::String input(event.text.unicode);
 
         if (event.text.unicode == '\b') {
-            bool selecionDeleted = editorContent.deleteSelections();
-            if (!selecionDeleted) {
-                editorContent.deleteTextBeforeCursorPos(1);
-            }
+            editorContent.deleteTextBeforeCursorPos(1);
         } else if (event.text.unicode == 127) {  
-            bool selecionDeleted = editorContent.deleteSelections();
-            if (!selecionDeleted) {
-                editorContent.deleteTextAfterCursorPos(1);
-            }
-        } else if (!ctrlPressed) {
+            editorContent.deleteTextAfterCursorPos(1);
+        } else if (!ctrlPressed && event.text.unicode != 27) {  // Escape only drops extra cursors
             if (event.text.unicode == '\t') {
                 std::cerr << "TABS ACTIVADOS " << std::endl;
             }
 
-            editorContent.deleteSelections();
             editorContent.addTextInCursorPos(input);
         }
     }
@@ -221,11 +236,17 @@ bool InputController::isMouseDown() {
     return this->mouseDown;
 }
 
+bool InputController::isAnimating() {
+    bool rotating = sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) &&
+                    sf::Keyboard::isKeyPressed(sf::Keyboard::R) &&
+                    (sf::Keyboard::isKeyPressed(sf::Keyboard::Left) || sf::Keyboard::isKeyPressed(sf::Keyboard::Right));
+    return this->isMouseDown() || rotating;
+}
+
 void InputController::updateCursorInEditor(EditorView &textView, float mouseX, float mouseY) {
     std::pair<int, int> docCoords = textView.getDocumentCoords(mouseX, mouseY);
     int line = docCoords.first;
     int column = docCoords.second;
 
-    this->editorContent.resetCursor(line, column);
-    this->editorContent.updateLastSelection(line, column);
+    this->editorContent.moveCursorTo(line, column, true);
 }
\ No newline at end of file
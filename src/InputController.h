@@ -13,6 +13,9 @@ class InputController {
     void handleConstantInput(EditorView &view, sf::RenderWindow &window);
     void handleEvents(EditorView &view, sf::RenderWindow &window, sf::Event &event);
     bool isMouseDown();
+    // True while handleConstantInput() has work to do with no events coming:
+    // a selection being dragged or the camera being rotated.
+    bool isAnimating();
 
    private:
     void handleMouseEvents(EditorView &view, sf::RenderWindow &window, sf::Event &event);
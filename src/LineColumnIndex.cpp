@@ -0,0 +1,218 @@
+#include "LineColumnIndex.h"
+
+#include <algorithm>
+
+LineColumnIndex::LineColumnIndex(TextDocument &document) :
+    document(document), version(document.getVersion()), tabWidth(document.getTabWidth()) {
+    this->document.addTextChangedListener(
+        [this](bool insertion, int lineN, int charN, PieceTable::Offset amount, int lineDelta) {
+            this->textChanged(insertion, lineN, charN, amount, lineDelta);
+        });
+}
+
+int LineColumnIndex::columnOf(int line, int charN) {
+    const std::vector<Chunk> &chunks = this->indexOf(line).chunks;
+    const Chunk &last = chunks.back();
+    charN = std::max(0, std::min(charN, last.firstChar + last.length));
+
+    const Chunk &chunk = chunks[chunkAt(chunks, charN)];
+    return chunk.firstColumn + this->columnIn(line, chunk, charN - chunk.firstChar);
+}
+
+int LineColumnIndex::charAt(int line, int column, int &charColumn) {
+    const std::vector<Chunk> &chunks = this->indexOf(line).chunks;
+    if (column <= 0) {
+        charColumn = 0;
+        return 0;
+    }
+    const Chunk &last = chunks.back();
+    if (column >= last.firstColumn + last.width) {
+        charColumn = last.firstColumn + last.width;
+        return last.firstChar + last.length;
+    }
+
+    auto next = std::upper_bound(chunks.begin(), chunks.end(), column,
+        [](int column, const Chunk &chunk) { return column < chunk.firstColumn; });
+    const Chunk &chunk = *(next - 1);
+    int charN = this->charIn(line, chunk, column - chunk.firstColumn, charColumn);
+    charColumn += chunk.firstColumn;
+    return chunk.firstChar + charN;
+}
+
+const LineColumnIndex::Line &LineColumnIndex::indexOf(int line) {
+    if (this->document.getVersion() != this->version || this->document.getTabWidth() != this->tabWidth) {
+        this->startOver();
+    }
+    auto it = this->lines.find(line);
+    if (it != this->lines.end()) {
+        return it->second;
+    }
+    if (this->lines.size() >= CACHED_LINES) {
+        this->lines.clear();
+    }
+
+    Line index;
+    this->scan(line, 0, 0, this->document.charsInLine(line), index.chunks);
+    return this->lines.emplace(line, std::move(index)).first->second;
+}
+
+void LineColumnIndex::startOver() {
+    this->lines.clear();
+    this->version = this->document.getVersion();
+    this->tabWidth = this->document.getTabWidth();
+}
+
+// Every change bumps the version at most once before it is reported, so a
+// bigger jump means the text was replaced without one, as when opening a file.
+void LineColumnIndex::textChanged(bool insertion, int lineN, int charN, PieceTable::Offset amount, int lineDelta) {
+    if (this->document.getVersion() > this->version + 1 || this->document.getTabWidth() != this->tabWidth) {
+        this->startOver();
+        return;
+    }
+    this->version = this->document.getVersion();
+
+    if (lineDelta != 0) {
+        int lastLine = lineN + std::max(0, -lineDelta);
+        std::unordered_map<int, Line> moved;
+        for (auto &entry : this->lines) {
+            if (entry.first < lineN) {
+                moved.emplace(entry.first, std::move(entry.second));
+            } else if (entry.first > lastLine) {
+                moved.emplace(entry.first + lineDelta, std::move(entry.second));
+            }
+        }
+        this->lines.swap(moved);
+        return;
+    }
+
+    auto it = this->lines.find(lineN);
+    if (it == this->lines.end() || amount == 0) {
+        return;
+    }
+    std::vector<Chunk> &chunks = it->second.chunks;
+    std::size_t first = chunkAt(chunks, charN);
+    std::size_t last = insertion ? first : chunkAt(chunks, charN + (int)amount - 1);
+    int charDelta = insertion ? (int)amount : -(int)amount;
+    int end = chunks[last].firstChar + chunks[last].length;
+    int endColumn = chunks[last].firstColumn + chunks[last].width;
+
+    // A chunk that got too short takes a neighbour along, so erasing never
+    // leaves a trail of tiny chunks.
+    if (end - chunks[first].firstChar + charDelta < CHUNK_CHARS) {
+        if (last + 1 < chunks.size()) {
+            last++;
+            end += chunks[last].length;
+            endColumn += chunks[last].width;
+        } else if (first > 0) {
+            first--;
+        }
+    }
+
+    std::vector<Chunk> rescanned;
+    int start = chunks[first].firstChar;
+    this->scan(lineN, start, chunks[first].firstColumn, end - start + charDelta, rescanned);
+    int columnDelta = rescanned.back().firstColumn + rescanned.back().width - endColumn;
+
+    chunks.erase(chunks.begin() + first, chunks.begin() + last + 1);
+    chunks.insert(chunks.begin() + first, std::make_move_iterator(rescanned.begin()),
+        std::make_move_iterator(rescanned.end()));
+    for (std::size_t i = first + rescanned.size(); i < chunks.size(); i++) {
+        chunks[i].firstChar += charDelta;
+        chunks[i].firstColumn += columnDelta;
+    }
+}
+
+// Cuts `length` characters from fromChar into chunks of CHUNK_CHARS, the last
+// one taking whatever is left over. There is always at least one.
+void LineColumnIndex::scan(int line, int fromChar, int fromColumn, int length, std::vector<Chunk> &into) const {
+    int tabWidth = this->tabWidth;
+    into.push_back(Chunk{fromChar, fromColumn, 0, 0, false, {}});
+    int left = length;
+    this->document.forEachRunInLine(line, fromChar, length, [&](const sf::Uint32 *data, int size) {
+        for (int i = 0; i < size; i++, left--) {
+            if (into.back().length == CHUNK_CHARS && left >= CHUNK_CHARS) {
+                const Chunk &full = into.back();
+                into.push_back(Chunk{full.firstChar + full.length, full.firstColumn + full.width, 0, 0, false, {}});
+            }
+            Chunk &chunk = into.back();
+            int width = ColumnWidth::of(data[i], tabWidth);
+            if (width != 1 && !chunk.dense) {
+                if (chunk.specials.size() < (std::size_t)CHUNK_SPECIALS) {
+                    chunk.specials.push_back(Special{chunk.length, chunk.width, width});
+                } else {
+                    chunk.dense = true;
+                    std::vector<Special>().swap(chunk.specials);
+                }
+            }
+            chunk.width += width;
+            chunk.length++;
+        }
+    });
+}
+
+// Column where character charN of the chunk starts, from the chunk start.
+int LineColumnIndex::columnIn(int line, const Chunk &chunk, int charN) const {
+    if (chunk.dense) {
+        int column = 0;
+        int tabWidth = this->tabWidth;
+        this->document.forEachRunInLine(line, chunk.firstChar, charN, [&](const sf::Uint32 *data, int size) {
+            for (int i = 0; i < size; i++) {
+                column += ColumnWidth::of(data[i], tabWidth);
+            }
+        });
+        return column;
+    }
+
+    auto next = std::lower_bound(chunk.specials.begin(), chunk.specials.end(), charN,
+        [](const Special &special, int charN) { return special.charN < charN; });
+    if (next == chunk.specials.begin()) {
+        return charN;
+    }
+    const Special &previous = *(next - 1);
+    return previous.column + previous.width + (charN - previous.charN - 1);
+}
+
+// Character of the chunk drawn over `column`, which is inside it; both from
+// the chunk start.
+int LineColumnIndex::charIn(int line, const Chunk &chunk, int column, int &charColumn) const {
+    if (chunk.dense) {
+        int charN = 0;
+        int start = 0;
+        bool found = false;
+        int tabWidth = this->tabWidth;
+        this->document.forEachRunInLine(line, chunk.firstChar, chunk.length, [&](const sf::Uint32 *data, int size) {
+            for (int i = 0; i < size && !found; i++) {
+                int width = ColumnWidth::of(data[i], tabWidth);
+                if (start + width > column) {
+                    found = true;
+                } else {
+                    start += width;
+                    charN++;
+                }
+            }
+        });
+        charColumn = start;
+        return charN;
+    }
+
+    int charN = column;
+    auto next = std::upper_bound(chunk.specials.begin(), chunk.specials.end(), column,
+        [](int column, const Special &special) { return column < special.column; });
+    if (next != chunk.specials.begin()) {
+        const Special &previous = *(next - 1);
+        if (column < previous.column + previous.width) {
+            charColumn = previous.column;
+            return previous.charN;
+        }
+        charN = previous.charN + 1 + (column - previous.column - previous.width);
+    }
+    charColumn = column;
+    return charN;
+}
+
+// Last chunk starting at or before charN.
+std::size_t LineColumnIndex::chunkAt(const std::vector<Chunk> &chunks, int charN) {
+    auto next = std::upper_bound(chunks.begin(), chunks.end(), charN,
+        [](int charN, const Chunk &chunk) { return charN < chunk.firstChar; });
+    return std::max<std::ptrdiff_t>(next - chunks.begin() - 1, 0);
+}
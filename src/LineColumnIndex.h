@@ -0,0 +1,72 @@
+#ifndef LineColumnIndex_H
+#define LineColumnIndex_H
+
+#include <SFML/Graphics.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "ColumnWidth.h"
+#include "TextDocument.h"
+
+// Maps character indices to screen columns and back. The first time a line
+// is asked about, it is scanned once into chunks of CHUNK_CHARS to twice as
+// many characters, each with the character and column it starts at. Within a
+// chunk, the characters that aren't one column wide (tabs, wide and
+// zero-width characters) are recorded with the column they start at, so a
+// lookup is a binary search over the chunks and then over those characters,
+// with no text read. A chunk with more than CHUNK_SPECIALS of them keeps none
+// and is read instead. An edit inside a line only scans again the chunks it
+// touched; one that adds or takes away lines drops the lines it touched.
+class LineColumnIndex {
+   public:
+    LineColumnIndex(TextDocument &document);
+
+    // Column where character charN of the line starts.
+    int columnOf(int line, int charN);
+    // Character drawn over `column`, with the column it starts at in
+    // charColumn. Past the end of the line, the line length and its width.
+    int charAt(int line, int column, int &charColumn);
+
+    // Lines indexed at the same time. Past this the cache starts over.
+    static const std::size_t CACHED_LINES = 4096;
+    static const int CHUNK_CHARS = 1024;
+    static const int CHUNK_SPECIALS = 128;
+
+   private:
+    // Relative to the start of its chunk.
+    struct Special {
+        int charN;
+        int column;
+        int width;
+    };
+
+    struct Chunk {
+        int firstChar;
+        int firstColumn;
+        int length;
+        int width;
+        // Set when there were too many specials to keep.
+        bool dense;
+        std::vector<Special> specials;
+    };
+
+    struct Line {
+        std::vector<Chunk> chunks;
+    };
+
+    TextDocument &document;
+    std::unordered_map<int, Line> lines;
+    // What the cached lines were scanned with.
+    unsigned long long version;
+    int tabWidth;
+
+    const Line &indexOf(int line);
+    void startOver();
+    void textChanged(bool insertion, int lineN, int charN, PieceTable::Offset amount, int lineDelta);
+    void scan(int line, int fromChar, int fromColumn, int length, std::vector<Chunk> &into) const;
+    int columnIn(int line, const Chunk &chunk, int charN) const;
+    int charIn(int line, const Chunk &chunk, int column, int &charColumn) const;
+    static std::size_t chunkAt(const std::vector<Chunk> &chunks, int charN);
+};
+
+#endif
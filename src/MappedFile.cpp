@@ -0,0 +1,122 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : bytes(nullptr), byteCount(0) {
+#ifdef _WIN32
+    this->fileHandle = nullptr;
+    this->mappingHandle = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    this->close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &filename) {
+    this->close();
+
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    this->fileHandle = file;
+    this->mappingHandle = mapping;
+    this->bytes = static_cast<const char *>(view);
+    this->byteCount = (std::size_t)fileSize.QuadPart;
+    this->filename = filename;
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->bytes) {
+        UnmapViewOfFile(this->bytes);
+        CloseHandle(this->mappingHandle);
+        CloseHandle(this->fileHandle);
+    }
+    this->bytes = nullptr;
+    this->byteCount = 0;
+    this->fileHandle = nullptr;
+    this->mappingHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &filename) {
+    this->close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *view = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    madvise(view, fileStat.st_size, MADV_SEQUENTIAL);
+
+    this->bytes = static_cast<const char *>(view);
+    this->byteCount = fileStat.st_size;
+    this->filename = filename;
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->bytes) {
+        munmap(const_cast<char *>(this->bytes), this->byteCount);
+    }
+    this->bytes = nullptr;
+    this->byteCount = 0;
+}
+
+#endif
+
+bool MappedFile::isOpen() const {
+    return this->bytes != nullptr;
+}
+
+const char *MappedFile::data() const {
+    return this->bytes;
+}
+
+std::size_t MappedFile::size() const {
+    return this->byteCount;
+}
+
+const std::string &MappedFile::getFilename() const {
+    return this->filename;
+}
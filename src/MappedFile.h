@@ -0,0 +1,37 @@
+#ifndef MappedFile_H
+#define MappedFile_H
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Read-only memory mapping of a whole file. The bytes stay in the page cache
+// and are only faulted in when something reads them.
+class MappedFile {
+   public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &filename);
+    void close();
+
+    bool isOpen() const;
+    const char *data() const;
+    std::size_t size() const;
+    const std::string &getFilename() const;
+
+   private:
+    const char *bytes;
+    std::size_t byteCount;
+    std::string filename;
+
+#ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#endif
+};
+
+#endif
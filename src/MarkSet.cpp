@@ -0,0 +1,205 @@
+#include "MarkSet.h"
+
+MarkSet::MarkSet() : root(nullptr), marks(0), seed(2463534242u) {}
+
+int MarkSet::add(Offset pos) {
+    int id;
+    if (this->freeIds.empty()) {
+        id = this->nodes.size();
+        this->nodes.emplace_back(new Node());
+    } else {
+        id = this->freeIds.back();
+        this->freeIds.pop_back();
+    }
+    Node *node = this->nodes[id].get();
+    node->priority = this->nextPriority();
+    this->link(node, pos);
+    this->marks++;
+    return id;
+}
+
+void MarkSet::remove(int id) {
+    this->unlink(this->nodes[id].get());
+    this->freeIds.push_back(id);
+    this->marks--;
+}
+
+// What is still waiting above the mark is brought down to it first.
+MarkSet::Offset MarkSet::get(int id) {
+    Node *node = this->nodes[id].get();
+    this->pushPath(node);
+    return node->pos;
+}
+
+void MarkSet::set(int id, Offset pos) {
+    Node *node = this->nodes[id].get();
+    this->unlink(node);
+    this->link(node, pos);
+}
+
+int MarkSet::count() const {
+    return this->marks;
+}
+
+void MarkSet::inserted(Offset pos, Offset amount) {
+    if (amount <= 0) {
+        return;
+    }
+    Node *left, *right;
+    split(this->root, pos, left, right);
+    move(right, amount);
+    this->root = merge(left, right);
+    if (this->root) {
+        this->root->parent = nullptr;
+    }
+}
+
+void MarkSet::erased(Offset pos, Offset amount) {
+    if (amount <= 0) {
+        return;
+    }
+    Node *left, *inside, *right;
+    split(this->root, pos, left, right);
+    split(right, pos + amount, inside, right);
+    collapse(inside, pos);
+    move(right, -amount);
+    this->root = merge(merge(left, inside), right);
+    if (this->root) {
+        this->root->parent = nullptr;
+    }
+}
+
+void MarkSet::rotated(Offset first, Offset middle, Offset end) {
+    Node *left, *before, *after, *right;
+    split(this->root, first, left, right);
+    split(right, middle, before, right);
+    split(right, end, after, right);
+    move(before, end - middle);
+    move(after, first - middle);
+    this->root = merge(merge(merge(left, after), before), right);
+    if (this->root) {
+        this->root->parent = nullptr;
+    }
+}
+
+unsigned MarkSet::nextPriority() {
+    this->seed ^= this->seed << 13;
+    this->seed ^= this->seed >> 17;
+    this->seed ^= this->seed << 5;
+    return this->seed;
+}
+
+// A node's own position is always current; the tags are for its children.
+void MarkSet::collapse(Node *node, Offset pos) {
+    if (!node) {
+        return;
+    }
+    node->pos = pos;
+    node->collapsed = true;
+    node->collapseTo = pos;
+    node->shift = 0;
+}
+
+void MarkSet::move(Node *node, Offset shift) {
+    if (!node) {
+        return;
+    }
+    node->pos += shift;
+    node->shift += shift;
+}
+
+void MarkSet::push(Node *node) {
+    if (node->collapsed) {
+        collapse(node->left, node->collapseTo);
+        collapse(node->right, node->collapseTo);
+        node->collapsed = false;
+    }
+    if (node->shift != 0) {
+        move(node->left, node->shift);
+        move(node->right, node->shift);
+        node->shift = 0;
+    }
+}
+
+void MarkSet::pushPath(Node *node) {
+    this->path.clear();
+    for (; node; node = node->parent) {
+        this->path.push_back(node);
+    }
+    for (auto it = this->path.rbegin(); it != this->path.rend(); ++it) {
+        push(*it);
+    }
+}
+
+// Marks before `pos` go left, the rest right.
+void MarkSet::split(Node *node, Offset pos, Node *&left, Node *&right) {
+    if (!node) {
+        left = nullptr;
+        right = nullptr;
+        return;
+    }
+    push(node);
+    if (node->pos < pos) {
+        split(node->right, pos, node->right, right);
+        if (node->right) {
+            node->right->parent = node;
+        }
+        left = node;
+    } else {
+        split(node->left, pos, left, node->left);
+        if (node->left) {
+            node->left->parent = node;
+        }
+        right = node;
+    }
+}
+
+MarkSet::Node *MarkSet::merge(Node *left, Node *right) {
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    if (left->priority > right->priority) {
+        push(left);
+        left->right = merge(left->right, right);
+        left->right->parent = left;
+        return left;
+    }
+    push(right);
+    right->left = merge(left, right->left);
+    right->left->parent = right;
+    return right;
+}
+
+void MarkSet::link(Node *node, Offset pos) {
+    node->pos = pos;
+    node->collapsed = false;
+    node->collapseTo = 0;
+    node->shift = 0;
+    node->left = nullptr;
+    node->right = nullptr;
+    node->parent = nullptr;
+
+    Node *left, *right;
+    split(this->root, pos, left, right);
+    this->root = merge(merge(left, node), right);
+    this->root->parent = nullptr;
+}
+
+void MarkSet::unlink(Node *node) {
+    this->pushPath(node);
+    Node *child = merge(node->left, node->right);
+    Node *parent = node->parent;
+    if (child) {
+        child->parent = parent;
+    }
+    if (!parent) {
+        this->root = child;
+    } else if (parent->left == node) {
+        parent->left = child;
+    } else {
+        parent->right = child;
+    }
+}
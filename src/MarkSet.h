@@ -0,0 +1,68 @@
+#ifndef MarkSet_H
+#define MarkSet_H
+
+#include <memory>
+#include <vector>
+
+#include "PieceTable.h"
+
+// Positions in the text that follow its edits, such as cursors or selection
+// ends. They are kept in a treap ordered by position, where a shift (or a
+// collapse onto one position) waits at the top of a subtree until someone
+// goes below it, so an edit costs O(log m) however many marks come after it.
+class MarkSet {
+   public:
+    typedef PieceTable::Offset Offset;
+
+    MarkSet();
+    MarkSet(const MarkSet &other) = delete;
+    MarkSet &operator=(const MarkSet &other) = delete;
+
+    // Ids are small numbers, handed out again once removed.
+    int add(Offset pos);
+    void remove(int id);
+    Offset get(int id);
+    void set(int id, Offset pos);
+    int count() const;
+
+    // A mark right where text is inserted ends up after it. Marks inside
+    // erased text end up where it was.
+    void inserted(Offset pos, Offset amount);
+    void erased(Offset pos, Offset amount);
+    // [first, middle) and [middle, end) traded places, and their marks went
+    // with them.
+    void rotated(Offset first, Offset middle, Offset end);
+
+   private:
+    struct Node {
+        Offset pos;
+        unsigned priority;
+        // Waiting for the subtree below: every position becomes collapseTo
+        // when collapsed, then moves by shift.
+        bool collapsed;
+        Offset collapseTo;
+        Offset shift;
+        Node *left;
+        Node *right;
+        Node *parent;
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<int> freeIds;
+    Node *root;
+    int marks;
+    unsigned seed;
+    std::vector<Node *> path;
+
+    unsigned nextPriority();
+    static void collapse(Node *node, Offset pos);
+    static void move(Node *node, Offset shift);
+    static void push(Node *node);
+    void pushPath(Node *node);
+    static void split(Node *node, Offset pos, Node *&left, Node *&right);
+    static Node *merge(Node *left, Node *right);
+    void link(Node *node, Offset pos);
+    void unlink(Node *node);
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "Minimap.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "ColumnWidth.h"
+#include "DirtyLines.h"
+#include "ThreadPool.h"
+
+namespace {
+
+const sf::Color BACKGROUND_COLOR(20, 26, 40);
+const sf::Color INK_COLOR(200, 200, 200, 200);
+const sf::Color VIEWPORT_COLOR(255, 255, 255, 40);
+
+void appendRect(sf::VertexArray &vertices, const sf::FloatRect &rect, const sf::Color &color) {
+    sf::Vector2f topLeft(rect.left, rect.top), topRight(rect.left + rect.width, rect.top);
+    sf::Vector2f bottomLeft(rect.left, rect.top + rect.height);
+    sf::Vector2f bottomRight(rect.left + rect.width, rect.top + rect.height);
+
+    vertices.append(sf::Vertex(topLeft, color));
+    vertices.append(sf::Vertex(topRight, color));
+    vertices.append(sf::Vertex(bottomLeft, color));
+    vertices.append(sf::Vertex(bottomLeft, color));
+    vertices.append(sf::Vertex(topRight, color));
+    vertices.append(sf::Vertex(bottomRight, color));
+}
+
+}  // namespace
+
+Minimap::Block::Block() : stale(false) {}
+
+Minimap::Minimap(TextDocument &document)
+    : document(document), nextGeneration(1), waiting(false), top(0), frameStale(true) {
+    this->document.addLinesChangedListener([this](int firstLine, int lastLine) {
+        this->invalidate(firstLine, lastLine);
+    });
+}
+
+void Minimap::setArea(const sf::IntRect &area, sf::Vector2u windowSize) {
+    this->area = area;
+    this->windowSize = windowSize;
+    this->frameStale = true;
+}
+
+bool Minimap::contains(int x, int y) const {
+    return this->area.contains(x, y);
+}
+
+int Minimap::lineAt(int y) const {
+    int line = std::floor((this->top + y - this->area.top) / LINE_PIXELS);
+    return std::max(0, std::min(line, this->document.getLineCount() - 1));
+}
+
+// The minimap scrolls in step with the editor: the top of the document shows
+// at the top of the panel when the camera is at the top, and the same for
+// the bottom.
+void Minimap::buildDisplayList(DisplayList &list, EditorView &view) {
+    this->collectRendered();
+    this->frameStale = false;
+
+    list.minimapBackground.clear();
+    list.minimapBlocks.clear();
+    list.minimapViewport.clear();
+    if (this->area.width <= 0 || this->area.height <= 0 || this->windowSize.x == 0 || this->windowSize.y == 0) {
+        return;
+    }
+
+    int lineCount = this->document.getLineCount();
+    sf::View camera = view.getCameraView();
+    float cameraTop = (camera.getCenter().y - camera.getSize().y / 2) / view.getLineHeight();
+    float cameraLines = camera.getSize().y / view.getLineHeight();
+
+    float documentHeight = lineCount * LINE_PIXELS;
+    this->top = 0;
+    if (documentHeight > this->area.height) {
+        float scrollableLines = lineCount - cameraLines;
+        float scrolled = scrollableLines > 0 ? std::max(0.f, std::min(1.f, cameraTop / scrollableLines)) : 0;
+        this->top = std::round(scrolled * (documentHeight - this->area.height));
+    }
+
+    list.minimapView.reset(sf::FloatRect(0, this->top, this->area.width, this->area.height));
+    list.minimapView.setViewport(sf::FloatRect(
+        (float)this->area.left / this->windowSize.x, (float)this->area.top / this->windowSize.y,
+        (float)this->area.width / this->windowSize.x, (float)this->area.height / this->windowSize.y));
+    appendRect(list.minimapBackground, sf::FloatRect(0, this->top, this->area.width, this->area.height),
+        BACKGROUND_COLOR);
+    appendRect(list.minimapViewport, sf::FloatRect(0, cameraTop * LINE_PIXELS, this->area.width,
+        cameraLines * LINE_PIXELS), VIEWPORT_COLOR);
+
+    const int blockHeight = BLOCK_LINES * LINE_PIXELS;
+    int firstBlock = this->top / blockHeight;
+    int lastBlock = std::min((int)(this->top + this->area.height) / blockHeight, (lineCount - 1) / BLOCK_LINES);
+
+    if (this->blocks.size() > BLOCK_LIMIT) {
+        for (auto it = this->blocks.begin(); it != this->blocks.end();) {
+            bool inSight = it->first >= firstBlock && it->first <= lastBlock;
+            it = inSight ? std::next(it) : this->blocks.erase(it);
+        }
+    }
+
+    // Missing blocks are drawn as soon as the batch in flight is done; stale
+    // ones show their old image until typing pauses too.
+    bool rendering = this->isRendering();
+    bool settled = this->isSettled();
+    std::vector<int> due;
+    this->waiting = false;
+    for (int index = firstBlock; index <= lastBlock; index++) {
+        Block &block = this->blocks[index];
+        if (!block.rendering.valid() && (!block.image || block.stale)) {
+            if (rendering || (block.image && !settled)) {
+                this->waiting = true;
+            } else {
+                due.push_back(index);
+            }
+        }
+        if (block.image) {
+            list.minimapBlocks.push_back(block.image);
+        }
+    }
+
+    if (!due.empty()) {
+        if (!this->snapshot || this->snapshot->getVersion() != this->document.getVersion()) {
+            this->snapshot = this->document.snapshot();
+        }
+        for (int index : due) {
+            this->startRendering(this->blocks[index], index);
+        }
+    } else if (!rendering && !this->waiting) {
+        this->snapshot.reset();
+    }
+}
+
+bool Minimap::needsRedraw() {
+    this->collectRendered();
+    if (this->waiting && this->isSettled() && !this->isRendering()) {
+        this->frameStale = true;
+    }
+    return this->frameStale;
+}
+
+bool Minimap::isBuilding() const {
+    return this->waiting || this->isRendering();
+}
+
+bool Minimap::isSettled() const {
+    return std::chrono::steady_clock::now() - this->lastChange >= std::chrono::milliseconds(+SETTLE_MS);
+}
+
+bool Minimap::isRendering() const {
+    for (const auto &entry : this->blocks) {
+        if (entry.second.rendering.valid()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Blocks keep their image while lines move around them, until they are in
+// sight again and get redrawn.
+void Minimap::invalidate(int firstLine, int lastLine) {
+    this->lastChange = std::chrono::steady_clock::now();
+    int firstBlock = firstLine / BLOCK_LINES;
+    int lastBlock = lastLine == DirtyLines::TO_END ? INT_MAX : lastLine / BLOCK_LINES;
+    for (auto it = this->blocks.lower_bound(firstBlock); it != this->blocks.end() && it->first <= lastBlock; ++it) {
+        it->second.stale = true;
+        this->waiting = true;
+    }
+}
+
+void Minimap::collectRendered() {
+    for (auto &entry : this->blocks) {
+        Block &block = entry.second;
+        if (block.rendering.valid() &&
+            block.rendering.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            block.image = block.rendering.get();
+            this->frameStale = true;
+        }
+    }
+}
+
+void Minimap::startRendering(Block &block, int index) {
+    std::shared_ptr<const DocumentSnapshot> snapshot = this->snapshot;
+    block.stale = false;
+    int tabWidth = this->document.getTabWidth();
+    unsigned long long generation = this->nextGeneration++;
+
+    auto rendered = std::make_shared<std::promise<std::shared_ptr<const MinimapBlock>>>();
+    block.rendering = rendered->get_future();
+    ThreadPool::shared().submit([snapshot, rendered, index, tabWidth, generation]() {
+        rendered->set_value(render(*snapshot, index, tabWidth, generation));
+    });
+}
+
+// Each line is a row of pixels, one per column, lit where the column has
+// something other than blanks. Only the columns that fit are read.
+std::shared_ptr<const MinimapBlock> Minimap::render(const DocumentSnapshot &snapshot, int index, int tabWidth,
+    unsigned long long generation) {
+    auto block = std::make_shared<MinimapBlock>();
+    block->index = index;
+    block->generation = generation;
+    block->image.create(WIDTH, BLOCK_LINES * LINE_PIXELS, sf::Color::Transparent);
+
+    int firstLine = index * BLOCK_LINES;
+    int lastLine = std::min(firstLine + BLOCK_LINES, snapshot.getLineCount()) - 1;
+    for (int line = firstLine; line <= lastLine; line++) {
+        int amount = std::min(snapshot.charsInLine(line), +WIDTH);
+        sf::String text = snapshot.getTextFromPos(amount, line, 0);
+        unsigned y = (line - firstLine) * LINE_PIXELS;
+
+        int column = 0;
+        for (sf::Uint32 c : text) {
+            int width = ColumnWidth::of(c, tabWidth);
+            if (c > ' ') {
+                for (int x = column; x < std::min(column + width, +WIDTH); x++) {
+                    block->image.setPixel(x, y, INK_COLOR);
+                }
+            }
+            column += width;
+            if (column >= WIDTH) {
+                break;
+            }
+        }
+    }
+    return block;
+}
@@ -0,0 +1,87 @@
+#ifndef Minimap_H
+#define Minimap_H
+
+#include <SFML/Graphics.hpp>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+
+#include "DisplayList.h"
+#include "DocumentSnapshot.h"
+#include "EditorView.h"
+#include "TextDocument.h"
+
+// Overview of the document in a panel next to the editor, one pixel per
+// column and LINE_PIXELS per line. The document is cut in blocks of
+// BLOCK_LINES lines, each drawn to an image on the shared thread pool from a
+// snapshot and kept until an edit touches its lines. Only the blocks in
+// sight are drawn: when the document is taller than the panel, the minimap
+// scrolls along with the editor. So opening a huge file never waits for the
+// minimap, and an edit only redraws the blocks it changed.
+//
+// Blocks an edit touched keep their old image until typing pauses for
+// SETTLE_MS. Only one batch of blocks is drawn at a time, all from the same
+// snapshot, which is reused while the document version stays the same.
+class Minimap {
+   public:
+    Minimap(TextDocument &document);
+
+    // Panel, in pixels of a window of windowSize.
+    void setArea(const sf::IntRect &area, sf::Vector2u windowSize);
+    bool contains(int x, int y) const;
+    // Line shown at window pixel row y in the last display list.
+    int lineAt(int y) const;
+
+    // Fills the minimap part of `list` for what `view` shows, and starts
+    // drawing the blocks in sight that are missing or out of date.
+    void buildDisplayList(DisplayList &list, EditorView &view);
+    // True when blocks finished drawing since the last display list.
+    bool needsRedraw();
+    // True while blocks are being drawn in the background, or wait for typing
+    // to pause to be drawn again.
+    bool isBuilding() const;
+
+    static const int WIDTH = 120;
+    static const int LINE_PIXELS = 2;
+    static const int BLOCK_LINES = 128;
+    // Blocks kept at the same time. Past this, the ones out of sight are
+    // dropped.
+    static const std::size_t BLOCK_LIMIT = 64;
+    static const int SETTLE_MS = 300;
+
+   private:
+    struct Block {
+        Block();
+
+        std::shared_ptr<const MinimapBlock> image;
+        std::future<std::shared_ptr<const MinimapBlock>> rendering;
+        // The lines changed since image (or rendering) was started.
+        bool stale;
+    };
+
+    TextDocument &document;
+    std::map<int, Block> blocks;
+    unsigned long long nextGeneration;
+    // What the last batch was drawn from. Let go once nothing is left to draw.
+    std::shared_ptr<const DocumentSnapshot> snapshot;
+    std::chrono::steady_clock::time_point lastChange;
+    // Blocks were left out of date, by an edit or in the last display list.
+    bool waiting;
+
+    sf::IntRect area;
+    sf::Vector2u windowSize;
+    // Minimap pixel row at the top of the panel in the last display list.
+    float top;
+    bool frameStale;
+
+    void invalidate(int firstLine, int lastLine);
+    bool isSettled() const;
+    bool isRendering() const;
+    void collectRendered();
+    void startRendering(Block &block, int index);
+    static std::shared_ptr<const MinimapBlock> render(const DocumentSnapshot &snapshot, int index, int tabWidth,
+        unsigned long long generation);
+};
+
+#endif
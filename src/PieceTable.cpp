@@ -0,0 +1,719 @@
+#include "PieceTable.h"
+
+// Text that has to be encoded on save goes through the encoder this many
+// characters at a time.
+constexpr int ENCODE_SLICE_CHARS = 1 << 16;
+
+PieceTable::Node::Node(const Piece &piece, unsigned priority)
+    : piece(piece), priority(priority), subtreeLength(piece.length), subtreeLineFeeds(piece.lineFeeds) {}
+
+void PieceTable::Node::update() {
+    this->subtreeLength = PieceTable::lengthOf(this->left)
+        + this->piece.length
+        + PieceTable::lengthOf(this->right);
+    this->subtreeLineFeeds = PieceTable::lineFeedsOf(this->left)
+        + this->piece.lineFeeds
+        + PieceTable::lineFeedsOf(this->right);
+}
+
+PieceTable::Buffer::Buffer()
+    : contents(std::make_shared<Text>()), lastUse(0), source(nullptr), sourceBytes(0), length(0),
+      lineFeeds(0), width(1), wellFormed(false) {}
+
+void PieceTable::Buffer::reserve(int width) {
+    this->contents->text.reserve(width, ADD_CHUNK_CHARS);
+    this->contents->lineBreaks.reserve(ADD_CHUNK_LINES);
+    this->width = width;
+}
+
+// How many of the first `size` characters of `data` fit in the room left,
+// at the chunk's width.
+int PieceTable::Buffer::room(const sf::Uint32 *data, int size) const {
+    int count = std::min(size, ADD_CHUNK_CHARS - this->length);
+    int breaksLeft = ADD_CHUNK_LINES - this->lineFeeds;
+    for (int i = 0; i < count; i++) {
+        if (CompactText::widthFor(data[i]) > this->width) {
+            return i;
+        }
+        if (PieceTable::isLineBreak(data[i]) && breaksLeft-- == 0) {
+            return i;
+        }
+    }
+    return count;
+}
+
+void PieceTable::Buffer::append(const sf::Uint32 *data, int size) {
+    Text &added = *this->contents;
+    int offset = added.text.size();
+    added.text.append(data, size);
+    for (int i = 0; i < size; i++) {
+        if (PieceTable::isLineBreak(data[i])) {
+            added.lineBreaks.push_back(offset + i);
+        }
+    }
+    this->length += size;
+    this->lineFeeds = added.lineBreaks.size();
+}
+
+std::shared_ptr<PieceTable::Text> PieceTable::Buffer::decode() const {
+    auto decoded = std::make_shared<Text>();
+    decoded->lineBreaks.reserve(this->lineFeeds);
+    decoded->text.assignUtf8(this->source, this->sourceBytes, this->width, decoded->lineBreaks);
+    return decoded;
+}
+
+PieceTable::DecodeCache::DecodeCache() : useClock(0) {}
+
+PieceTable::Span::Span() : pieceCount(0), textBytes(0) {}
+
+PieceTable::Span::Span(Span &&other)
+    : root(std::move(other.root)), pieceCount(other.pieceCount), textBytes(other.textBytes) {
+    other.pieceCount = 0;
+    other.textBytes = 0;
+}
+
+PieceTable::Span &PieceTable::Span::operator=(Span &&other) {
+    this->root = std::move(other.root);
+    this->pieceCount = other.pieceCount;
+    this->textBytes = other.textBytes;
+    other.pieceCount = 0;
+    other.textBytes = 0;
+    return *this;
+}
+
+PieceTable::Span::~Span() {}
+
+PieceTable::Offset PieceTable::Span::length() const {
+    return PieceTable::lengthOf(this->root);
+}
+
+std::size_t PieceTable::Span::memoryUsage() const {
+    return sizeof(Span) + this->pieceCount * sizeof(Node) + this->textBytes;
+}
+
+PieceTable::Span PieceTable::Span::share() const {
+    Span span;
+    span.root = this->root;
+    span.pieceCount = this->pieceCount;
+    span.textBytes = this->textBytes;
+    return span;
+}
+
+PieceTable::PieceTable() : seed(2463534242u) {
+    this->reset();
+}
+
+// The copy reads the add chunk this table appends to, but never appends to
+// it itself.
+PieceTable PieceTable::snapshot() {
+    PieceTable copy(*this);
+    copy.addBuffer = -1;
+    return copy;
+}
+
+// The copied chunks are new Buffers with a cache of their own, as the ones
+// snapshots share may be decoding from the mapping meanwhile.
+void PieceTable::detachSource() {
+    if (!this->source) {
+        return;
+    }
+    const char *mapped = this->source->data();
+    auto copy = std::make_shared<const std::vector<char>>(mapped, mapped + this->source->size());
+    auto buffers = std::make_shared<BufferList>(*this->buffers);
+    for (std::shared_ptr<Buffer> &buffer : *buffers) {
+        if (!buffer || !buffer->source) {
+            continue;
+        }
+        auto chunk = std::make_shared<Buffer>();
+        chunk->contents.reset();
+        chunk->source = copy->data() + (buffer->source - mapped);
+        chunk->sourceBytes = buffer->sourceBytes;
+        chunk->length = buffer->length;
+        chunk->lineFeeds = buffer->lineFeeds;
+        chunk->width = buffer->width;
+        chunk->wellFormed = buffer->wellFormed;
+        buffer = chunk;
+    }
+    this->buffers = buffers;
+    this->cache = std::make_shared<DecodeCache>();
+    this->sourceCopy = copy;
+    this->source.reset();
+}
+
+void PieceTable::reset() {
+    this->source.reset();
+    this->sourceCopy.reset();
+    this->buffers = std::make_shared<BufferList>();
+    this->cache = std::make_shared<DecodeCache>();
+    this->addBuffer = -1;
+    this->root.reset();
+}
+
+void PieceTable::load(const sf::String &text) {
+    this->reset();
+
+    auto original = std::make_shared<Buffer>();
+    original->append(text.getData(), text.getSize());
+    this->pushBuffer(original);
+
+    if (original->length > 0) {
+        this->root = this->makeNode(this->makePiece(0, 0, original->length));
+    }
+}
+
+void PieceTable::load(std::shared_ptr<MappedFile> file) {
+    this->load(file, ThreadPool::shared());
+}
+
+// Cuts the mapping into chunks that end on UTF-8 sequence boundaries, never
+// inside a "\r\n" pair, and counts the characters and line breaks of each one on the pool. Nothing is
+// decoded yet; the treap built from the per-chunk counts is the prefix sum
+// that turns them into the global line index.
+void PieceTable::load(std::shared_ptr<MappedFile> file, ThreadPool &pool) {
+    this->reset();
+    this->source = file;
+
+    const char *bytes = file->data();
+    std::size_t size = file->size();
+    std::size_t pos = 0;
+
+    while (pos < size) {
+        std::size_t end = std::min(size, pos + SOURCE_CHUNK_BYTES);
+        for (int back = 0; back < 3 && end < size && ((unsigned char)bytes[end] & 0xC0) == 0x80; back++) {
+            end--;
+        }
+        if (end < size && bytes[end] == '\n' && bytes[end - 1] == 13) {
+            end--;
+        }
+
+        auto chunk = std::make_shared<Buffer>();
+        chunk->contents.reset();
+        chunk->source = bytes + pos;
+        chunk->sourceBytes = end - pos;
+        this->buffers->push_back(chunk);
+        pos = end;
+    }
+
+    auto scanChunk = [this](int index) {
+        Buffer &chunk = *(*this->buffers)[index];
+        Utf8Codec::Counts counts = Utf8Codec::count(chunk.source, chunk.sourceBytes);
+        chunk.length = counts.chars;
+        chunk.lineFeeds = counts.lineFeeds;
+        chunk.width = CompactText::widthFor(counts.maxCodePoint);
+        chunk.wellFormed = counts.malformed == 0;
+    };
+    int chunkCount = this->buffers->size();
+    if (chunkCount >= PARALLEL_SCAN_MIN_CHUNKS) {
+        pool.parallelFor(chunkCount, scanChunk);
+    } else {
+        for (int i = 0; i < chunkCount; i++) {
+            scanChunk(i);
+        }
+    }
+
+    for (int i = 0; i < chunkCount; i++) {
+        const Buffer &chunk = this->bufferAt(i);
+        this->root = merge(std::move(this->root),
+            this->makeNode(Piece{i, 0, chunk.length, chunk.lineFeeds, 0}));
+    }
+}
+
+PieceTable::Offset PieceTable::length() const {
+    return lengthOf(this->root);
+}
+
+int PieceTable::lineCount() const {
+    return lineFeedsOf(this->root) + 1;
+}
+
+// Position of the first character of `line`, found by descending on the line
+// break counts and finishing with a binary search inside one piece.
+PieceTable::Offset PieceTable::lineStart(int line) const {
+    if (line <= 0) {
+        return 0;
+    }
+    Offset offset = 0;
+    const Node *node = this->root.get();
+    while (node) {
+        int leftLineFeeds = lineFeedsOf(node->left);
+        const Piece &piece = node->piece;
+
+        if (line <= leftLineFeeds) {
+            node = node->left.get();
+        } else if (line <= leftLineFeeds + piece.lineFeeds) {
+            TextPtr text = this->textOf(piece.buffer);
+            const std::vector<int> &breaks = text->lineBreaks;
+            int breakPos = breaks[piece.firstBreak + (line - leftLineFeeds - 1)];
+            return offset + lengthOf(node->left) + breakPos - piece.start + 1;
+        } else {
+            line -= leftLineFeeds + piece.lineFeeds;
+            offset += lengthOf(node->left) + piece.length;
+            node = node->right.get();
+        }
+    }
+    std::cerr << "PieceTable: line " << line << " out of range\n";
+    return this->length();
+}
+
+bool PieceTable::isLineBreak(sf::Uint32 c) {
+    return c == '\n' || c == 13;
+}
+
+void PieceTable::insert(Offset pos, const sf::String &text) {
+    int textSize = text.getSize();
+    if (textSize == 0) {
+        return;
+    }
+    pos = std::max(0LL, std::min(pos, this->length()));
+
+    NodePtr left, right;
+    this->split(std::move(this->root), pos, left, right);
+
+    int written = 0;
+    while (written < textSize) {
+        const sf::Uint32 *data = text.getData() + written;
+        int amount = this->addBuffer < 0 ? 0 : this->bufferAt(this->addBuffer).room(data, textSize - written);
+        if (amount == 0) {
+            int count = std::min(textSize - written, +ADD_CHUNK_CHARS);
+            sf::Uint32 widest = *std::max_element(data, data + count);
+            auto chunk = std::make_shared<Buffer>();
+            chunk->reserve(CompactText::widthFor(widest));
+            this->addBuffer = this->pushBuffer(chunk);
+            amount = chunk->room(data, count);
+        }
+        Buffer &added = *(*this->buffers)[this->addBuffer];
+        int addedStart = added.length;
+        added.append(data, amount);
+        written += amount;
+
+        Piece piece = this->makePiece(this->addBuffer, addedStart, amount);
+        if (!this->extendLastPiece(left, piece)) {
+            left = merge(std::move(left), this->makeNode(piece));
+        }
+    }
+    this->root = merge(std::move(left), std::move(right));
+}
+
+void PieceTable::insert(Offset pos, Span span) {
+    if (!span.root) {
+        return;
+    }
+    pos = std::max(0LL, std::min(pos, this->length()));
+
+    NodePtr left, right;
+    this->split(std::move(this->root), pos, left, right);
+    left = merge(std::move(left), std::move(span.root));
+    this->root = merge(std::move(left), std::move(right));
+}
+
+PieceTable::Span PieceTable::extract(Offset pos, Offset amount) {
+    Offset totalLength = this->length();
+    pos = std::max(0LL, std::min(pos, totalLength));
+    amount = std::min(amount, totalLength - pos);
+
+    Span span;
+    if (amount <= 0) {
+        return span;
+    }
+
+    NodePtr left, right;
+    this->split(std::move(this->root), pos, left, span.root);
+    this->split(std::move(span.root), amount, span.root, right);
+    this->root = merge(std::move(left), std::move(right));
+    this->measure(span.root.get(), span);
+    return span;
+}
+
+// Marks every chunk a piece still points into. Source chunks are left alone:
+// their text is the mapped file, which stays mapped anyway.
+void PieceTable::releaseUnusedChunks(const std::vector<const Span *> &kept) {
+    std::vector<bool> used(this->buffers->size(), false);
+    markUsed(this->root.get(), used);
+    for (const Span *span : kept) {
+        markUsed(span->root.get(), used);
+    }
+
+    for (std::size_t i = 0; i < used.size(); i++) {
+        const std::shared_ptr<Buffer> &chunk = (*this->buffers)[i];
+        if (used[i] || !chunk || chunk->source || (int)i == this->addBuffer) {
+            continue;
+        }
+        if (!isUnique(this->buffers)) {
+            this->buffers = std::make_shared<BufferList>(*this->buffers);
+        }
+        (*this->buffers)[i].reset();
+    }
+}
+
+int PieceTable::lineOf(Offset pos) const {
+    int line = 0;
+    const Node *node = this->root.get();
+    while (node) {
+        Offset leftLength = lengthOf(node->left);
+        const Piece &piece = node->piece;
+
+        if (pos <= leftLength) {
+            node = node->left.get();
+        } else if (pos <= leftLength + piece.length) {
+            TextPtr text = this->textOf(piece.buffer);
+            const std::vector<int> &breaks = text->lineBreaks;
+            auto first = breaks.begin() + piece.firstBreak;
+            auto last = std::lower_bound(first, first + piece.lineFeeds, piece.start + (pos - leftLength));
+            return line + lineFeedsOf(node->left) + (last - first);
+        } else {
+            line += lineFeedsOf(node->left) + piece.lineFeeds;
+            pos -= leftLength + piece.length;
+            node = node->right.get();
+        }
+    }
+    return line;
+}
+
+void PieceTable::erase(Offset pos, Offset amount) {
+    Offset totalLength = this->length();
+    pos = std::max(0LL, std::min(pos, totalLength));
+    amount = std::min(amount, totalLength - pos);
+    if (amount <= 0) {
+        return;
+    }
+
+    NodePtr left, middle, right;
+    this->split(std::move(this->root), pos, left, middle);
+    this->split(std::move(middle), amount, middle, right);
+    this->root = merge(std::move(left), std::move(right));
+}
+
+sf::Uint32 PieceTable::charAt(Offset pos) const {
+    const Node *node = this->root.get();
+    while (node) {
+        Offset leftLength = lengthOf(node->left);
+        if (pos < leftLength) {
+            node = node->left.get();
+        } else if (pos < leftLength + node->piece.length) {
+            return this->textOf(node->piece.buffer)->text.at(node->piece.start + pos - leftLength);
+        } else {
+            pos -= leftLength + node->piece.length;
+            node = node->right.get();
+        }
+    }
+    std::cerr << "PieceTable: position " << pos << " out of range\n";
+    return 0;
+}
+
+sf::String PieceTable::substring(Offset pos, Offset amount) const {
+    Utf32Buffer out;
+    if (amount > 0) {
+        out.reserve(amount);
+        this->collect(this->root.get(), pos, pos + amount, out);
+    }
+    return sf::String(out);
+}
+
+void PieceTable::forEachRun(const std::function<void(const sf::Uint32 *, int)> &visitor) const {
+    this->forEachRun(0, this->length(), visitor);
+}
+
+void PieceTable::forEachRun(Offset pos, Offset amount,
+    const std::function<void(const sf::Uint32 *, int)> &visitor) const {
+    Utf32Buffer scratch;
+    this->visit(this->root.get(), pos, pos + amount, visitor, scratch);
+}
+
+void PieceTable::forEachUtf8Run(const std::function<void(const char *, std::size_t)> &visitor) const {
+    Utf8Visit state;
+    state.buffer = -1;
+    this->visitUtf8(this->root.get(), visitor, state);
+}
+
+const PieceTable::Buffer &PieceTable::bufferAt(int buffer) const {
+    return *(*this->buffers)[buffer];
+}
+
+int PieceTable::pushBuffer(const std::shared_ptr<Buffer> &buffer) {
+    if (!isUnique(this->buffers)) {
+        this->buffers = std::make_shared<BufferList>(*this->buffers);
+    }
+    this->buffers->push_back(buffer);
+    return this->buffers->size() - 1;
+}
+
+// Returns the contents of a buffer, decoding a source chunk if needed and
+// evicting the least recently used chunk once too many are decoded. Whoever
+// still holds an evicted chunk's contents keeps them alive.
+PieceTable::TextPtr PieceTable::textOf(int buffer) const {
+    const Buffer &result = this->bufferAt(buffer);
+    if (!result.source) {
+        return result.contents;
+    }
+
+    DecodeCache &decodeCache = *this->cache;
+    std::lock_guard<std::mutex> lock(decodeCache.mutex);
+    result.lastUse = ++decodeCache.useClock;
+
+    if (!result.contents) {
+        result.contents = result.decode();
+        decodeCache.decodedChunks.push_back(buffer);
+
+        if ((int)decodeCache.decodedChunks.size() > DECODED_CHUNK_LIMIT) {
+            auto oldest = std::min_element(decodeCache.decodedChunks.begin(), decodeCache.decodedChunks.end(),
+                [this](int a, int b) { return this->bufferAt(a).lastUse < this->bufferAt(b).lastUse; });
+            this->bufferAt(*oldest).contents.reset();
+            decodeCache.decodedChunks.erase(oldest);
+        }
+    }
+    return result.contents;
+}
+
+// Only the table appending to an add chunk cuts pieces of it, so it may look
+// at all of the chunk's line breaks.
+PieceTable::Piece PieceTable::makePiece(int buffer, int start, int length) const {
+    const Buffer &whole = this->bufferAt(buffer);
+    if (start == 0 && length == whole.length) {
+        return Piece{buffer, start, length, whole.lineFeeds, 0};
+    }
+
+    TextPtr text = this->textOf(buffer);
+    const std::vector<int> &breaks = text->lineBreaks;
+    auto first = std::lower_bound(breaks.begin(), breaks.end(), start);
+    auto last = std::lower_bound(first, breaks.end(), start + length);
+    return Piece{buffer, start, length, (int)(last - first), (int)(first - breaks.begin())};
+}
+
+unsigned PieceTable::nextPriority() {
+    this->seed ^= this->seed << 13;
+    this->seed ^= this->seed >> 17;
+    this->seed ^= this->seed << 5;
+    return this->seed;
+}
+
+PieceTable::NodePtr PieceTable::makeNode(const Piece &piece) {
+    return std::make_shared<Node>(piece, this->nextPriority());
+}
+
+PieceTable::Offset PieceTable::lengthOf(const NodePtr &node) {
+    return node ? node->subtreeLength : 0;
+}
+
+int PieceTable::lineFeedsOf(const NodePtr &node) {
+    return node ? node->subtreeLineFeeds : 0;
+}
+
+void PieceTable::measure(const Node *node, Span &span) const {
+    if (!node) {
+        return;
+    }
+    const Buffer &buffer = this->bufferAt(node->piece.buffer);
+    int width = buffer.source ? buffer.width : buffer.contents->text.getWidth();
+    span.pieceCount++;
+    span.textBytes += (std::size_t)node->piece.length * width;
+    this->measure(node->left.get(), span);
+    this->measure(node->right.get(), span);
+}
+
+void PieceTable::markUsed(const Node *node, std::vector<bool> &used) {
+    if (!node) {
+        return;
+    }
+    used[node->piece.buffer] = true;
+    markUsed(node->left.get(), used);
+    markUsed(node->right.get(), used);
+}
+
+// A use count of one means no snapshot can reach the object, and the fence
+// orders our writes after whatever the last other owner did before letting go.
+template <typename T>
+bool PieceTable::isUnique(const std::shared_ptr<T> &pointer) {
+    if (pointer.use_count() != 1) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+// Returns the node ready to be changed, copying it first if it is shared. The
+// copy holds its own references to the children, so they are copied in turn
+// when the change reaches them.
+PieceTable::Node *PieceTable::own(NodePtr &node) {
+    if (!isUnique(node)) {
+        node = std::make_shared<Node>(*node);
+    }
+    return node.get();
+}
+
+// Splits the tree so that `left` holds the first `pos` characters. A piece
+// straddling `pos` is cut in two.
+void PieceTable::split(NodePtr node, Offset pos, NodePtr &left, NodePtr &right) {
+    if (!node) {
+        left.reset();
+        right.reset();
+        return;
+    }
+
+    Node *owned = own(node);
+    Offset leftLength = lengthOf(owned->left);
+    int pieceLength = owned->piece.length;
+
+    if (pos <= leftLength) {
+        this->split(std::move(owned->left), pos, left, owned->left);
+        owned->update();
+        right = std::move(node);
+    } else if (pos >= leftLength + pieceLength) {
+        this->split(std::move(owned->right), pos - leftLength - pieceLength, owned->right, right);
+        owned->update();
+        left = std::move(node);
+    } else {
+        int offset = pos - leftLength;
+        Piece tail = this->makePiece(owned->piece.buffer, owned->piece.start + offset, pieceLength - offset);
+        owned->piece = this->makePiece(owned->piece.buffer, owned->piece.start, offset);
+
+        right = merge(this->makeNode(tail), std::move(owned->right));
+        owned->update();
+        left = std::move(node);
+    }
+}
+
+PieceTable::NodePtr PieceTable::merge(NodePtr left, NodePtr right) {
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    if (left->priority > right->priority) {
+        Node *owned = own(left);
+        owned->right = merge(std::move(owned->right), std::move(right));
+        owned->update();
+        return left;
+    }
+    Node *owned = own(right);
+    owned->left = merge(std::move(left), std::move(owned->left));
+    owned->update();
+    return right;
+}
+
+// Typing appends to the add buffer right after the previous insertion, so the
+// last piece can usually grow in place instead of adding a new node.
+bool PieceTable::extendLastPiece(NodePtr &node, const Piece &piece) {
+    const Node *last = node.get();
+    while (last && last->right) {
+        last = last->right.get();
+    }
+    if (!last || last->piece.buffer != piece.buffer
+        || last->piece.start + last->piece.length != piece.start) {
+        return false;
+    }
+
+    for (NodePtr *current = &node; *current; current = &(*current)->right) {
+        Node *owned = own(*current);
+        if (!owned->right) {
+            owned->piece.length += piece.length;
+            owned->piece.lineFeeds += piece.lineFeeds;
+        }
+        owned->subtreeLength += piece.length;
+        owned->subtreeLineFeeds += piece.lineFeeds;
+    }
+    return true;
+}
+
+void PieceTable::collect(const Node *node, Offset from, Offset to, Utf32Buffer &out) const {
+    if (!node || from >= to) {
+        return;
+    }
+    Offset leftLength = lengthOf(node->left);
+    int pieceLength = node->piece.length;
+
+    if (from < leftLength) {
+        this->collect(node->left.get(), from, std::min(to, leftLength), out);
+    }
+
+    Offset pieceFrom = std::max(from - leftLength, 0LL);
+    Offset pieceTo = std::min(to - leftLength, (Offset)pieceLength);
+    if (pieceFrom < pieceTo) {
+        TextPtr text = this->textOf(node->piece.buffer);
+        text->text.appendTo(out, node->piece.start + pieceFrom, pieceTo - pieceFrom);
+    }
+
+    Offset rightOffset = leftLength + pieceLength;
+    if (to > rightOffset) {
+        this->collect(node->right.get(), std::max(from - rightOffset, 0LL), to - rightOffset, out);
+    }
+}
+
+// Narrow buffers are widened into `scratch` before being handed out.
+void PieceTable::visit(const Node *node, Offset from, Offset to,
+    const std::function<void(const sf::Uint32 *, int)> &visitor, Utf32Buffer &scratch) const {
+    if (!node || from >= to) {
+        return;
+    }
+    Offset leftLength = lengthOf(node->left);
+    int pieceLength = node->piece.length;
+
+    if (from < leftLength) {
+        this->visit(node->left.get(), from, std::min(to, leftLength), visitor, scratch);
+    }
+
+    int pieceFrom = std::max(from - leftLength, 0LL);
+    int pieceTo = std::min(to - leftLength, (Offset)pieceLength);
+    if (pieceFrom < pieceTo) {
+        TextPtr contents = this->textOf(node->piece.buffer);
+        const CompactText &text = contents->text;
+        int start = node->piece.start + pieceFrom;
+        int count = pieceTo - pieceFrom;
+        if (text.wideData()) {
+            visitor(text.wideData() + start, count);
+        } else {
+            scratch.resize(count);
+            text.copyTo(&scratch[0], start, count);
+            visitor(scratch.data(), count);
+        }
+    }
+
+    Offset rightOffset = leftLength + pieceLength;
+    if (to > rightOffset) {
+        this->visit(node->right.get(), std::max(from - rightOffset, 0LL), to - rightOffset, visitor, scratch);
+    }
+}
+
+void PieceTable::visitUtf8(const Node *node, const std::function<void(const char *, std::size_t)> &visitor,
+    Utf8Visit &state) const {
+    if (!node) {
+        return;
+    }
+    this->visitUtf8(node->left.get(), visitor, state);
+
+    const Piece &piece = node->piece;
+    const Buffer &buffer = this->bufferAt(piece.buffer);
+    if (buffer.source && buffer.wellFormed) {
+        if (state.buffer != piece.buffer || state.charPos > piece.start) {
+            state.buffer = piece.buffer;
+            state.charPos = 0;
+            state.bytePos = 0;
+        }
+        int start = state.bytePos + Utf8Codec::byteOffset(buffer.source + state.bytePos,
+            buffer.sourceBytes - state.bytePos, piece.start - state.charPos);
+        int end = start + Utf8Codec::byteOffset(buffer.source + start,
+            buffer.sourceBytes - start, piece.length);
+        visitor(buffer.source + start, end - start);
+        state.charPos = piece.start + piece.length;
+        state.bytePos = end;
+    } else {
+        TextPtr contents = this->textOf(piece.buffer);
+        const CompactText &text = contents->text;
+        for (int done = 0; done < piece.length; done += ENCODE_SLICE_CHARS) {
+            int count = std::min(piece.length - done, ENCODE_SLICE_CHARS);
+            const sf::Uint32 *run;
+            if (text.wideData()) {
+                run = text.wideData() + piece.start + done;
+            } else {
+                state.scratch.resize(count);
+                text.copyTo(&state.scratch[0], piece.start + done, count);
+                run = state.scratch.data();
+            }
+            state.encoded.resize((std::size_t)count * Utf8Codec::MAX_BYTES_PER_CHAR);
+            int bytes = Utf8Codec::encode(run, count, state.encoded.data());
+            visitor(state.encoded.data(), bytes);
+        }
+    }
+
+    this->visitUtf8(node->right.get(), visitor, state);
+}
@@ -0,0 +1,238 @@
+#ifndef PieceTable_H
+#define PieceTable_H
+
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CompactText.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Utf8Codec.h"
+
+// Text storage made of immutable source buffers and an append-only add
+// buffer. The document is the in-order concatenation of the pieces kept in a
+// treap, so inserting or erasing costs O(log pieces) whatever the text size.
+// Every node also counts the line breaks below it, which makes the treap the
+// document's line index.
+//
+// Nodes and buffers are shared, never changed while someone else holds them
+// (add chunks only grow past what anyone else can see), so snapshot() is a
+// constant time copy that other threads can read while this table keeps
+// being edited.
+class PieceTable {
+   private:
+    struct Node;
+
+   public:
+    typedef std::basic_string<sf::Uint32> Utf32Buffer;
+    typedef long long Offset;
+
+    // Pieces cut out of the table. They still reference the original buffers,
+    // so keeping removed text around (e.g. for undo) copies no characters.
+    class Span {
+       public:
+        Span();
+        Span(Span &&other);
+        Span &operator=(Span &&other);
+        ~Span();
+
+        Offset length() const;
+        // The nodes, and the characters of the chunks they keep alive at the
+        // width those chunks store them.
+        std::size_t memoryUsage() const;
+        // Another span with the same pieces, which are shared, not copied.
+        Span share() const;
+
+       private:
+        friend class PieceTable;
+        std::shared_ptr<Node> root;
+        int pieceCount;
+        std::size_t textBytes;
+    };
+
+    PieceTable();
+    PieceTable(PieceTable &&other) = default;
+    PieceTable &operator=(PieceTable &&other) = default;
+
+    // Read-only copy of the current contents. Const members of the copy may be
+    // used from any thread, concurrently with edits to this table.
+    PieceTable snapshot();
+    // Copies the mapped file to memory and reads the source chunks from the
+    // copy, so the file can be replaced. Snapshots taken before keep the
+    // mapping until they are gone.
+    void detachSource();
+
+    void load(const sf::String &text);
+    void load(std::shared_ptr<MappedFile> file);
+    void load(std::shared_ptr<MappedFile> file, ThreadPool &pool);
+
+    Offset length() const;
+    int lineCount() const;
+    Offset lineStart(int line) const;
+
+    void insert(Offset pos, const sf::String &text);
+    void insert(Offset pos, Span span);
+    void erase(Offset pos, Offset amount);
+    Span extract(Offset pos, Offset amount);
+
+    // Frees the add chunks that neither this table nor `kept` has pieces of
+    // any more. Snapshots that still read them keep them until they go.
+    void releaseUnusedChunks(const std::vector<const Span *> &kept);
+
+    // Line that contains the character at `pos`.
+    int lineOf(Offset pos) const;
+
+    sf::Uint32 charAt(Offset pos) const;
+    sf::String substring(Offset pos, Offset amount) const;
+
+    // Calls visitor(data, size) with every stored run of text, in order.
+    void forEachRun(const std::function<void(const sf::Uint32 *, int)> &visitor) const;
+    // Same, only for the text in [pos, pos + amount).
+    void forEachRun(Offset pos, Offset amount, const std::function<void(const sf::Uint32 *, int)> &visitor) const;
+    // Same, with the text as UTF-8. Text still in a well-formed source chunk
+    // is handed out straight from the file instead of being decoded.
+    void forEachUtf8Run(const std::function<void(const char *, std::size_t)> &visitor) const;
+
+    static bool isLineBreak(sf::Uint32 c);
+
+    // A mapped file is split into chunks of about this many bytes. Only the
+    // chunks somebody reads get decoded, and at most DECODED_CHUNK_LIMIT of
+    // them are kept decoded at the same time.
+    static const int SOURCE_CHUNK_BYTES = 1 << 20;
+    static const int DECODED_CHUNK_LIMIT = 16;
+    // Files with fewer chunks than this are scanned on the calling thread.
+    static const int PARALLEL_SCAN_MIN_CHUNKS = 8;
+    // Inserted text is appended to add chunks of at most this many
+    // characters and ADD_CHUNK_LINES line breaks. The room is reserved up
+    // front and holds characters of one width, so the chunk never moves while
+    // snapshots read it; text that doesn't fit starts the next chunk.
+    static const int ADD_CHUNK_CHARS = 1 << 16;
+    static const int ADD_CHUNK_LINES = 1 << 12;
+
+   private:
+    struct Text {
+        CompactText text;
+        std::vector<int> lineBreaks;
+    };
+    typedef std::shared_ptr<const Text> TextPtr;
+
+    // Either an add chunk, which is only appended to, or one chunk of the
+    // source file. A source chunk knows its length, line count and character
+    // width from the load scan and decodes its contents on demand.
+    struct Buffer {
+        Buffer();
+
+        // Guarded by DecodeCache::mutex for source chunks.
+        mutable std::shared_ptr<Text> contents;
+        mutable unsigned long long lastUse;
+
+        const char *source;
+        int sourceBytes;
+        int length;
+        int lineFeeds;
+        int width;
+        bool wellFormed;
+
+        void reserve(int width);
+        int room(const sf::Uint32 *data, int size) const;
+        void append(const sf::Uint32 *data, int size);
+        std::shared_ptr<Text> decode() const;
+    };
+    typedef std::vector<std::shared_ptr<Buffer>> BufferList;
+
+    // Source chunks currently decoded, shared by every snapshot of a load.
+    struct DecodeCache {
+        DecodeCache();
+
+        std::mutex mutex;
+        std::vector<int> decodedChunks;
+        unsigned long long useClock;
+    };
+
+    struct Piece {
+        int buffer;
+        int start;
+        int length;
+        int lineFeeds;
+        // Index in the buffer's line breaks of the first one in the piece, so
+        // readers never look past the breaks it has.
+        int firstBreak;
+    };
+
+    struct Node {
+        Node(const Piece &piece, unsigned priority);
+
+        Piece piece;
+        unsigned priority;
+        Offset subtreeLength;
+        int subtreeLineFeeds;
+        std::shared_ptr<Node> left;
+        std::shared_ptr<Node> right;
+
+        void update();
+    };
+
+    typedef std::shared_ptr<Node> NodePtr;
+
+    // What the source chunks read from: the mapped file, or a copy of it once
+    // detached.
+    std::shared_ptr<MappedFile> source;
+    std::shared_ptr<const std::vector<char>> sourceCopy;
+    std::shared_ptr<BufferList> buffers;
+    std::shared_ptr<DecodeCache> cache;
+    // Add chunk receiving inserted text, or -1 when the next insert has to
+    // start a new one.
+    int addBuffer;
+
+    NodePtr root;
+    unsigned seed;
+
+    PieceTable(const PieceTable &other) = default;
+    PieceTable &operator=(const PieceTable &other) = delete;
+
+    void reset();
+    const Buffer &bufferAt(int buffer) const;
+    int pushBuffer(const std::shared_ptr<Buffer> &buffer);
+    TextPtr textOf(int buffer) const;
+    Piece makePiece(int buffer, int start, int length) const;
+    unsigned nextPriority();
+
+    NodePtr makeNode(const Piece &piece);
+    static Offset lengthOf(const NodePtr &node);
+    static int lineFeedsOf(const NodePtr &node);
+    void measure(const Node *node, Span &span) const;
+    static void markUsed(const Node *node, std::vector<bool> &used);
+    static Node *own(NodePtr &node);
+    template <typename T>
+    static bool isUnique(const std::shared_ptr<T> &pointer);
+
+    void split(NodePtr node, Offset pos, NodePtr &left, NodePtr &right);
+    static NodePtr merge(NodePtr left, NodePtr right);
+    bool extendLastPiece(NodePtr &node, const Piece &piece);
+
+    void collect(const Node *node, Offset from, Offset to, Utf32Buffer &out) const;
+    void visit(const Node *node, Offset from, Offset to, const std::function<void(const sf::Uint32 *, int)> &visitor,
+        Utf32Buffer &scratch) const;
+
+    // Where the previous piece of a source chunk ended, so consecutive pieces
+    // of the same chunk don't rescan it from the start.
+    struct Utf8Visit {
+        Utf32Buffer scratch;
+        std::vector<char> encoded;
+        int buffer;
+        int charPos;
+        int bytePos;
+    };
+
+    void visitUtf8(const Node *node, const std::function<void(const char *, std::size_t)> &visitor,
+        Utf8Visit &state) const;
+};
+
+#endif
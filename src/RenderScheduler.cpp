@@ -0,0 +1,43 @@
+#include "RenderScheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+RenderScheduler::RenderScheduler() : framePending(true), animating(false) {}
+
+void RenderScheduler::requestFrame() {
+    this->framePending = true;
+}
+
+void RenderScheduler::setAnimating(bool animating) {
+    if (animating && !this->animating) {
+        this->nextTick = std::chrono::steady_clock::now();
+    }
+    this->animating = animating;
+}
+
+bool RenderScheduler::nextEvent(sf::Window &window, sf::Event &event) {
+    if (this->framePending) {
+        return window.pollEvent(event);
+    }
+
+    if (this->animating) {
+        if (window.pollEvent(event)) {
+            return true;
+        }
+        std::this_thread::sleep_until(this->nextTick);
+        this->nextTick = std::max(this->nextTick + std::chrono::milliseconds(+FRAME_INTERVAL_MS),
+            std::chrono::steady_clock::now());
+        return false;
+    }
+
+    return window.waitEvent(event);
+}
+
+bool RenderScheduler::shouldDraw() const {
+    return this->framePending;
+}
+
+void RenderScheduler::frameDrawn() {
+    this->framePending = false;
+}
@@ -0,0 +1,34 @@
+#ifndef RenderScheduler_H
+#define RenderScheduler_H
+
+#include <SFML/Graphics.hpp>
+#include <chrono>
+
+// Decides when the editor loop draws. A frame is only drawn after something
+// on screen changed, or at the frame rate while something animates (e.g. a
+// selection dragged past the window edge). The rest of the time the loop
+// sleeps in waitEvent, so an idle editor uses no CPU and a keystroke is
+// handled as soon as it arrives.
+class RenderScheduler {
+   public:
+    RenderScheduler();
+
+    void requestFrame();
+    void setAnimating(bool animating);
+
+    // Next event to handle. Returns false when it is time to draw (or to
+    // tick the animation), blocking until then while there is nothing to do.
+    bool nextEvent(sf::Window &window, sf::Event &event);
+
+    bool shouldDraw() const;
+    void frameDrawn();
+
+    static const int FRAME_INTERVAL_MS = 16;
+
+   private:
+    bool framePending;
+    bool animating;
+    std::chrono::steady_clock::time_point nextTick;
+};
+
+#endif
@@ -1,126 +1,116 @@
 #include "SelectionData.h"
 
-SelectionData::SelectionData() : lastSelectionIndex(-1) {}
+#include <algorithm>
 
-void SelectionData::createNewSelection(int anclaLine, int anclaChar) {
-    this->selections.push_back(Selection(anclaLine, anclaChar));
-    this->lastSelectionIndex++;
-}
+SelectionData::SelectionData() : rangesStale(false) {}
 
-void SelectionData::updateLastSelection(int extremoLine, int extremoChar) {
-    if (this->lastSelectionIndex < 0) {
-        return;
-    }
+int SelectionData::count() const {
+    return this->selections.size();
+}
 
-    int anclaLine = this->getLastAnclaLine();
-    int anclaChar = this->getLastAnclaChar();
+SelectionData::Selection SelectionData::get(int index) const {
+    return this->selections[index];
+}
 
-    bool nuevaActiva = (anclaLine != extremoLine) || (anclaChar != extremoChar);
-    this->selections[this->lastSelectionIndex].activa = nuevaActiva;
+void SelectionData::set(int index, const Selection &selection) {
+    this->selections[index] = selection;
+    this->rangesStale = true;
+}
 
-    this->selections[this->lastSelectionIndex].extremo.lineN = extremoLine;
-    this->selections[this->lastSelectionIndex].extremo.charN = extremoChar;
+void SelectionData::assign(std::vector<Selection> selections) {
+    this->selections = std::move(selections);
+    this->rangesStale = true;
 }
 
+// The first range ending after the character is the only one that can hold
+// it.
 bool SelectionData::isSelected(int lineN, int charN) const {
-    for (const Selection sel : this->selections) {
-        if (!sel.activa) {
-            continue;
-        }
-
-        SelectionData::Extremo start;
-        SelectionData::Extremo end;
-
-        if (sel.ancla < sel.extremo) {
-            start = sel.ancla;
-            end = sel.extremo;
-        } else {
-            start = sel.extremo;
-            end = sel.ancla;
-        }
-
-        if (start.lineN <= lineN && lineN <= end.lineN) {
-          
-            if (start.lineN < lineN && lineN < end.lineN) {
-                return true;
-            }
-
-            else if (start.lineN == lineN && lineN < end.lineN) {
-                if (start.charN <= charN) {
-                    return true;
-                }
-            }
-            else if (start.lineN < lineN && lineN == end.lineN) {
-                if (charN < end.charN) {
-                    return true;
-                }
-            }
+    this->updateRanges();
+    Extremo position(lineN, charN);
+    auto it = std::upper_bound(this->ranges.begin(), this->ranges.end(), position,
+        [](const Extremo &position, const Range &range) { return position < range.end; });
+    return it != this->ranges.end() && !(position < it->start);
+}
 
-            else if (start.lineN == lineN && lineN == end.lineN) {
-                if (start.charN <= charN && charN < end.charN) {
-                    return true;
-                }
+void SelectionData::getSpans(int firstLine, int lastLine, std::vector<Span> &spans) const {
+    this->updateRanges();
+    Extremo lineStart(firstLine, 0);
+    auto it = std::upper_bound(this->ranges.begin(), this->ranges.end(), lineStart,
+        [](const Extremo &position, const Range &range) { return position < range.end; });
+
+    for (; it != this->ranges.end() && it->start.lineN <= lastLine; ++it) {
+        int first = std::max(it->start.lineN, firstLine);
+        int last = std::min(it->end.lineN, lastLine);
+        for (int lineN = first; lineN <= last; lineN++) {
+            Span span;
+            span.lineN = lineN;
+            span.startChar = lineN == it->start.lineN ? it->start.charN : 0;
+            span.endChar = lineN == it->end.lineN ? it->end.charN : LINE_END;
+            if (span.startChar < span.endChar) {
+                spans.push_back(span);
             }
         }
     }
-    return false;
 }
 
-void SelectionData::removeSelections() {
-    int lastIndex = this->selections.size() - 1;
-    for (int i = lastIndex; i >= 0; i--) {
-        this->removeSelection(i);
+void SelectionData::updateRanges() const {
+    if (!this->rangesStale) {
+        return;
+    }
+    this->rangesStale = false;
+    this->ranges.clear();
+
+    for (const Selection &sel : this->selections) {
+        if (sel.activa) {
+            Range range;
+            range.start = sel.ancla < sel.extremo ? sel.ancla : sel.extremo;
+            range.end = sel.ancla < sel.extremo ? sel.extremo : sel.ancla;
+            this->ranges.push_back(range);
+        }
+    }
+    std::sort(this->ranges.begin(), this->ranges.end(),
+        [](const Range &a, const Range &b) { return a.start < b.start; });
+
+    std::size_t merged = 0;
+    for (std::size_t i = 1; i < this->ranges.size(); i++) {
+        Range &last = this->ranges[merged];
+        if (!(last.end < this->ranges[i].start)) {
+            if (last.end < this->ranges[i].end) {
+                last.end = this->ranges[i].end;
+            }
+        } else {
+            this->ranges[++merged] = this->ranges[i];
+        }
+    }
+    if (!this->ranges.empty()) {
+        this->ranges.resize(merged + 1);
     }
 }
 
-void SelectionData::removeSelection(int index) {
-    this->validIndex(index);
-    this->selections.erase(this->selections.begin() + index);
-    this->lastSelectionIndex--;
-}
-
-SelectionData::Selection SelectionData::getLastSelection() {
-    if (this->validIndex(this->lastSelectionIndex)) {
-        return this->selections[this->lastSelectionIndex];
+void SelectionData::addSelectedLines(DirtyLines &lines) const {
+    for (const Selection &sel : this->selections) {
+        if (sel.activa) {
+            lines.add(getStartLineN(sel), getEndLineN(sel));
+        }
     }
-    return SelectionData::Selection();
 }
 
-int SelectionData::getStartLineN(Selection &selection) {
+int SelectionData::getStartLineN(const Selection &selection) {
     auto extremoStart = selection.ancla < selection.extremo ? selection.ancla : selection.extremo;
     return extremoStart.lineN;
 }
 
-int SelectionData::getStartCharN(Selection &selection) {
+int SelectionData::getStartCharN(const Selection &selection) {
     auto extremoStart = selection.ancla < selection.extremo ? selection.ancla : selection.extremo;
     return extremoStart.charN;
 }
 
-int SelectionData::getEndLineN(Selection &selection) {
+int SelectionData::getEndLineN(const Selection &selection) {
     auto extremoEnd = selection.ancla < selection.extremo ? selection.extremo : selection.ancla;
     return extremoEnd.lineN;
 }
 
-int SelectionData::getEndCharN(Selection &selection) {
+int SelectionData::getEndCharN(const Selection &selection) {
     auto extremoEnd = selection.ancla < selection.extremo ? selection.extremo : selection.ancla;
     return extremoEnd.charN;
 }
-
-bool SelectionData::validIndex(int index) {
-    if (index < 0 || index >= (int)this->selections.size()) {
-        return false;
-    }
-    return true;
-}
-
-int SelectionData::getLastAnclaLine() {
-    return this->selections[this->lastSelectionIndex].ancla.lineN;
-}
-
-int SelectionData::getLastAnclaChar() {
-    return this->selections[this->lastSelectionIndex].ancla.charN;
-}
-
-int SelectionData::getLastIsActive() {
-    return this->selections[this->lastSelectionIndex].activa;
-}
\ No newline at end of file
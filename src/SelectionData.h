@@ -1,9 +1,10 @@
 #ifndef SelectionData_H
 #define SelectionData_H
 
+#include <climits>
 #include <iostream>
 #include <vector>
-#include "TextDocument.h"
+#include "DirtyLines.h"
 
 class SelectionData {
    private:
@@ -24,38 +25,57 @@ class SelectionData {
     struct Selection {
         Selection() : activa(false), ancla(), extremo() {}
         Selection(int anclaLine, int anclaChar) : activa(false), ancla(anclaLine, anclaChar), extremo() {}
+        Selection(int anclaLine, int anclaChar, int extremoLine, int extremoChar)
+            : activa(anclaLine != extremoLine || anclaChar != extremoChar),
+              ancla(anclaLine, anclaChar), extremo(extremoLine, extremoChar) {}
 
         bool activa;
         SelectionData::Extremo ancla;
         SelectionData::Extremo extremo;
     };
 
-    void createNewSelection(int anclaLine, int anclaChar);
-    void updateLastSelection(int extremoLine, int extremoChar);
-
-    void removeSelections();
-    bool isSelected(int lineN, int charN) const;
+    // Selected part of one line, from startChar up to endChar (not included).
+    // endChar is LINE_END when the selection goes on past the end of the line.
+    struct Span {
+        int lineN;
+        int startChar;
+        int endChar;
+    };
+    static const int LINE_END = INT_MAX;
 
-    Selection getLastSelection();
+    // Selection i belongs to cursor i of the editor: it goes from where the
+    // selection started (ancla) to the cursor (extremo).
+    int count() const;
+    Selection get(int index) const;
+    void set(int index, const Selection &selection);
+    void assign(std::vector<Selection> selections);
 
-    void moveSelectionsRight(int charAmount, const TextDocument &doc);
-    void moveSelectionsLeft(int charAmount, const TextDocument &doc);
+    bool isSelected(int lineN, int charN) const;
+    // Appends the spans of lines firstLine to lastLine, in order. Takes
+    // O(log n + k) for n merged selections and k spans.
+    void getSpans(int firstLine, int lastLine, std::vector<Span> &spans) const;
+    // Adds the lines covered by every active selection.
+    void addSelectedLines(DirtyLines &lines) const;
 
-    static int getStartLineN(Selection &selection);
-    static int getStartCharN(Selection &selection);
-    static int getEndLineN(Selection &selection);
-    static int getEndCharN(Selection &selection);
+    static int getStartLineN(const Selection &selection);
+    static int getStartCharN(const Selection &selection);
+    static int getEndLineN(const Selection &selection);
+    static int getEndCharN(const Selection &selection);
 
    private:
-    std::vector<Selection> selections;
-    int lastSelectionIndex;
+    struct Range {
+        Extremo start;
+        Extremo end;
+    };
 
-    int getLastAnclaLine();
-    int getLastAnclaChar();
-    int getLastIsActive();
+    std::vector<Selection> selections;
+    // Active selections sorted by start, with the ones that overlap or touch
+    // merged, so no two share a character. Rebuilt when first needed after
+    // the selections change.
+    mutable std::vector<Range> ranges;
+    mutable bool rangesStale;
 
-    bool validIndex(int index);
-    void removeSelection(int index);
+    void updateRanges() const;
 };
 
 #endif
\ No newline at end of file
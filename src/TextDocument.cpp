@@ -1,128 +1,471 @@
 #include "TextDocument.h"
 
+TextDocument::TextDocument()
+    : length(0), version(0), savedVersion(0), loadedVersion(0), tabWidth(ColumnWidth::DEFAULT_TAB_WIDTH) {
+    this->history.setDropListener([this](const std::vector<const PieceTable::Span *> &kept) {
+        this->buffer.releaseUnusedChunks(kept);
+    });
+}
+
+// A journal left behind by unsaved changes is only kept for the next session.
+TextDocument::~TextDocument() {
+    this->journal.close(!this->hasChanged());
+}
+
+// Marks of the text being replaced all end up at the start of the new one.
+// Nothing is reset until the file opened, so a failed open leaves the current
+// text, its history, marks and journal as they were.
 bool TextDocument::init(string &filename) {
-    std::ifstream inputFile(filename);
-    if (!inputFile.is_open()) {
-        std::cerr << "Error opening file: " << filename << std::endl;
-        return false;
+    auto mappedFile = std::make_shared<MappedFile>();
+    bool mapped = mappedFile->open(filename);
+    std::ifstream inputFile;
+    if (!mapped) {
+        inputFile.open(filename, std::ios::binary);
+        if (!inputFile.is_open()) {
+            std::cerr << "Error opening file: " << filename << std::endl;
+            return false;
+        }
     }
-    std::stringstream inputStringStream;
-    inputStringStream << inputFile.rdbuf();
 
-    this->buffer = this->toUtf32(inputStringStream.str());
-    this->length = buffer.getSize();  
+    this->history.clear();
+    this->marks.erased(0, this->length);
+    {
+        std::lock_guard<std::mutex> lock(this->saveMutex);
+        this->journal.close(!this->hasChanged());
+    }
 
-    inputFile.close();
-    this->initLinebuffer();
+    if (mapped) {
+        this->buffer.load(mappedFile);
+    } else {
+        std::stringstream inputStringStream;
+        inputStringStream << inputFile.rdbuf();
+        this->buffer.load(this->toUtf32(inputStringStream.str()));
+        inputFile.close();
+    }
+    this->recoverJournal(filename);
+    this->metrics.reset(this->buffer, this->tabWidth);
+    this->notifyLinesChanged(0, DirtyLines::TO_END);
     return true;
 }
 
+// Replays the edits a previous session journaled but never saved, then keeps
+// journaling on top of them. A background save may still be running, so the
+// save state only changes under its lock.
+void TextDocument::recoverJournal(const string &filename) {
+    std::lock_guard<std::mutex> lock(this->saveMutex);
+    this->savedFilename = filename;
+    unsigned long long baseVersion, lastVersion;
+    bool recovered = EditJournal::replay(filename, [this](const EditJournal::Edit &edit) {
+        PieceTable::Offset currentLength = this->buffer.length();
+        if (edit.pos < 0 || edit.pos > currentLength || edit.pos + edit.amount > currentLength) {
+            return false;
+        }
+        if (edit.move) {
+            if (edit.to < 0 || edit.to > currentLength - edit.amount) {
+                return false;
+            }
+            this->buffer.insert(edit.to, this->buffer.extract(edit.pos, edit.amount));
+        } else if (edit.insertion) {
+            this->buffer.insert(edit.pos, toUtf32(edit.text));
+        } else {
+            this->buffer.erase(edit.pos, edit.amount);
+        }
+        return true;
+    }, baseVersion, lastVersion);
+    this->length = this->buffer.length();
+
+    this->version++;
+    if (recovered) {
+        std::cerr << "Recovered unsaved changes to " << filename << std::endl;
+        this->version = std::max(this->version, lastVersion + 1);
+        this->savedVersion = baseVersion;
+        this->journal.open(filename, baseVersion, true);
+    } else {
+        this->savedVersion = this->version;
+        this->journal.open(filename, this->version, false);
+    }
+    this->loadedVersion = this->version;
+}
+
 bool TextDocument::saveFile(string &filename) {
-    std::ofstream outputFile(filename);
-    if (!outputFile.is_open()) {
-        std::cerr << "Error opening file: " << filename << std::endl;
+    return this->save(*this->snapshotToSave(), filename);
+}
+
+std::future<bool> TextDocument::saveFileInBackground(const string &filename) {
+    auto documentSnapshot = this->snapshotToSave();
+    auto saved = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = saved->get_future();
+
+    ThreadPool::shared().submit([this, documentSnapshot, filename, saved]() {
+        saved->set_value(this->save(*documentSnapshot, filename));
+    });
+    return result;
+}
+
+// Windows won't replace a file that is still mapped, so there the text stops
+// reading from the mapping before it is saved.
+std::shared_ptr<const DocumentSnapshot> TextDocument::snapshotToSave() {
+#ifdef _WIN32
+    this->buffer.detachSource();
+#endif
+    return this->snapshot();
+}
+
+// Saves run one at a time, and one that lost the race against a newer save
+// of the same file leaves it alone. A snapshot taken before the current file
+// was opened is still written, but says nothing about the current text.
+bool TextDocument::save(const DocumentSnapshot &documentSnapshot, const string &filename) {
+    std::lock_guard<std::mutex> lock(this->saveMutex);
+    bool current = documentSnapshot.getVersion() >= this->loadedVersion;
+    if (current && filename == this->savedFilename && documentSnapshot.getVersion() < this->savedVersion) {
+        return true;
+    }
+    if (!documentSnapshot.saveTo(filename)) {
         return false;
     }
-    std::stringstream toBeSaved;
-    for (sf::Uint32 ch : this->buffer) {
-        toBeSaved << SpecialChars::convertSpecialChar(ch, outputFile);
+    if (current) {
+        this->markSaved(filename, documentSnapshot.getVersion());
     }
-    outputFile << toBeSaved.str();
-
-    outputFile.close();
-
-    this->documentHasChanged = false;
     return true;
 }
 
-bool TextDocument::hasChanged() {
-    return this->documentHasChanged;
+void TextDocument::markSaved(const string &filename, unsigned long long savedAt) {
+    this->savedVersion = savedAt;
+    this->savedFilename = filename;
+    this->journal.rebase(filename, savedAt);
 }
 
-bool TextDocument::initLinebuffer() {
-    int lineStart = 0;
-    this->lineBuffer.clear();
-    this->lineBuffer.push_back(lineStart);
+unsigned long long TextDocument::getVersion() const {
+    return this->version;
+}
 
-    int bufferSize = this->buffer.getSize();
+std::shared_ptr<const DocumentSnapshot> TextDocument::snapshot() {
+    return std::make_shared<DocumentSnapshot>(this->buffer.snapshot(), this->version);
+}
 
-    for (int i = 0; i < bufferSize; i++) {
-        if (this->buffer[i] == '\n' || this->buffer[i] == 13) {
-            lineStart = i + 1;
-            this->lineBuffer.push_back(lineStart);
-        }
-    }
-    return true;
+bool TextDocument::hasChanged() {
+    return this->version != this->savedVersion;
 }
 
 sf::String TextDocument::getLine(int lineNumber) {
-    int lastLine = this->lineBuffer.size() - 1;
+    int lastLine = this->getLineCount() - 1;
 
     if (lineNumber < 0 || lineNumber > lastLine) {
         std::cerr << "lineNumber " << lineNumber << " is not a valid number line. "
-                  << "Max is: " << this->lineBuffer.size() - 1 << std::endl;
+                  << "Max is: " << lastLine << std::endl;
         return "";
     }
 
-    if (lineNumber == lastLine) {
-        return this->buffer.substring(this->lineBuffer[lineNumber]);
+    PieceTable::Offset bufferStart = this->buffer.lineStart(lineNumber);
+    return this->buffer.substring(bufferStart, this->charsInLine(lineNumber));
+}
 
-    } else {
-        int bufferStart = this->lineBuffer[lineNumber];
-        int nextBufferStart = this->lineBuffer[lineNumber + 1];  
-        int cantidad = nextBufferStart - bufferStart - 1;
+void TextDocument::forEachRunInLine(int lineNumber,
+    const std::function<void(const sf::Uint32 *, int)> &visitor) const {
+    if (lineNumber < 0 || lineNumber >= this->getLineCount()) {
+        return;
+    }
+    this->buffer.forEachRun(this->buffer.lineStart(lineNumber), this->charsInLine(lineNumber), visitor);
+}
 
-        return this->buffer.substring(bufferStart, cantidad);
+void TextDocument::forEachRunInLine(int lineNumber, int charN, int amount,
+    const std::function<void(const sf::Uint32 *, int)> &visitor) const {
+    if (lineNumber < 0 || lineNumber >= this->getLineCount() || amount <= 0) {
+        return;
     }
+    this->buffer.forEachRun(this->buffer.lineStart(lineNumber) + charN, amount, visitor);
 }
 
 sf::String TextDocument::toUtf32(const std::string &inString) {
-    sf::String outString = "";
-    auto iterEnd = inString.cend();
+    Utf8Codec::Utf32Buffer decoded;
+    std::vector<int> lineBreaks;
+    Utf8Codec::decode(inString.data(), inString.size(), decoded, lineBreaks);
+    return sf::String(decoded);
+}
 
-    for (auto iter = inString.cbegin(); iter != iterEnd;) {
-        sf::Uint32 out;
-        iter = sf::Utf8::decode(iter, iterEnd, out);
-        outString += out;
-    }
+void TextDocument::addTextToPos(sf::String text, int line, int charN) {
+    PieceTable::Offset bufferInsertPos = this->getBufferPos(line, charN);
+    this->insertAt(bufferInsertPos, text);
+}
 
-    return outString;
+void TextDocument::removeTextFromPos(int amount, int lineN, int charN) {
+    PieceTable::Offset bufferStartPos = this->getBufferPos(lineN, charN);
+    this->eraseAt(bufferStartPos, amount);
 }
 
-void TextDocument::addTextToPos(sf::String text, int line, int charN) {
-    this->documentHasChanged = true;
+void TextDocument::insertAt(PieceTable::Offset pos, const sf::String &text) {
+    int lineCountBefore = this->getLineCount();
+    this->applyInsert(pos, text);
+    this->notifyChangeAt(pos, lineCountBefore);
+}
+
+void TextDocument::eraseAt(PieceTable::Offset pos, PieceTable::Offset amount) {
+    int lineCountBefore = this->getLineCount();
+    this->applyErase(pos, amount);
+    this->notifyChangeAt(pos, lineCountBefore);
+}
+
+void TextDocument::applyInsert(PieceTable::Offset pos, const sf::String &text) {
+    this->version++;
+    int lineCountBefore = this->getLineCount();
+
+    this->metrics.beforeChange(this->buffer, true, pos, text.getSize());
+    this->buffer.insert(pos, text);
+    this->metrics.afterChange(this->buffer, true, pos, text.getSize());
+    this->length = this->buffer.length();
+    this->notifyTextChanged(true, pos, text.getSize(), lineCountBefore);
+    this->marks.inserted(pos, text.getSize());
+    this->journal.recordInsert(this->version, pos, text);
 
-    int textSize = text.getSize();
-    int bufferInsertPos = this->getBufferPos(line, charN);
-    this->buffer.insert(bufferInsertPos, text);
+    bool canCoalesce = text.getSize() == 1 && !PieceTable::isLineBreak(text[0]);
+    this->history.recordInsert(pos, text.getSize(), canCoalesce);
+}
+
+PieceTable::Offset TextDocument::applyErase(PieceTable::Offset pos, PieceTable::Offset amount) {
+    this->version++;
+    int lineCountBefore = this->getLineCount();
+
+    this->metrics.beforeChange(this->buffer, false, pos, amount);
+    PieceTable::Span removed = this->buffer.extract(pos, amount);
+    PieceTable::Offset removedLength = removed.length();
+    this->metrics.afterChange(this->buffer, false, pos, removedLength);
+    this->length = this->buffer.length();
+    this->notifyTextChanged(false, pos, removedLength, lineCountBefore);
+    this->marks.erased(pos, removedLength);
+    this->journal.recordErase(this->version, pos, removedLength);
+
+    this->history.recordErase(pos, std::move(removed));
+    return removedLength;
+}
 
-    int lineAmount = this->lineBuffer.size();
-    for (int l = line + 1; l < lineAmount; l++) {
-        this->lineBuffer[l] += textSize;
+// Every position is found before the first edit, and each edit is then moved
+// by what the ones before it added or removed: a batch of n edits costs n
+// piece table edits, and the lines between them are only reported once.
+bool TextDocument::applyEdits(const std::vector<Edit> &edits, std::vector<std::pair<int, int>> &textEnds) {
+    textEnds.clear();
+    std::vector<PieceTable::Offset> starts;
+    starts.reserve(edits.size());
+    int changes = 0;
+    for (const Edit &edit : edits) {
+        bool valid = edit.lineN >= 0 && edit.lineN < this->getLineCount() && edit.charN >= 0 && edit.amount >= 0;
+        PieceTable::Offset start = valid ? this->getBufferPos(edit.lineN, edit.charN) : 0;
+        if (!valid || start + edit.amount > this->length ||
+            (!starts.empty() && start < starts.back() + edits[starts.size() - 1].amount)) {
+            std::cerr << "Can't apply edit at " << edit.lineN << ":" << edit.charN
+                      << ", it is outside the text or overlaps the edit before it\n";
+            return false;
+        }
+        starts.push_back(start);
+        changes += (edit.amount > 0 ? 1 : 0) + (edit.text.isEmpty() ? 0 : 1);
     }
 
-    for (int i = 0; i < (int)text.getSize(); i++) {
-        if (text[i] == '\n' || text[i] == 13) {          
-            int newLineStart = bufferInsertPos + i + 1;  
+    // A lone change stays an ordinary edit, which typing can coalesce with.
+    bool grouped = changes > 1;
+    if (grouped) {
+        this->history.beginGroup();
+    }
+    int lineCountBefore = this->getLineCount();
+    int firstLine = -1;
+    PieceTable::Offset shift = 0;
+    PieceTable::Offset lastChangeEnd = 0;
+    std::vector<PieceTable::Offset> ends;
+    ends.reserve(edits.size());
+    for (std::size_t i = 0; i < edits.size(); i++) {
+        const Edit &edit = edits[i];
+        PieceTable::Offset pos = starts[i] + shift;
+        if (edit.amount > 0) {
+            shift -= this->applyErase(pos, edit.amount);
+        }
+        if (!edit.text.isEmpty()) {
+            this->applyInsert(pos, edit.text);
+            shift += edit.text.getSize();
+        }
+        ends.push_back(pos + edit.text.getSize());
 
-            this->lineBuffer.insert(
-                std::lower_bound(this->lineBuffer.begin(), this->lineBuffer.end(), newLineStart),
-                newLineStart);
+        if (edit.amount > 0 || !edit.text.isEmpty()) {
+            if (firstLine < 0) {
+                firstLine = edit.lineN;
+            }
+            lastChangeEnd = ends.back();
         }
     }
+    if (grouped) {
+        this->history.endGroup();
+    }
+
+    if (firstLine >= 0) {
+        int lastLine = this->getLineCount() == lineCountBefore ? this->buffer.lineOf(lastChangeEnd) : DirtyLines::TO_END;
+        this->notifyLinesChanged(firstLine, lastLine);
+    }
+    for (PieceTable::Offset end : ends) {
+        int lineN, charN;
+        this->getLineAndChar(end, lineN, charN);
+        textEnds.emplace_back(lineN, charN);
+    }
+    return true;
 }
 
-void TextDocument::removeTextFromPos(int amount, int lineN, int charN) {
-    this->documentHasChanged = true;
+void TextDocument::beginEdit() {
+    this->pendingEdits.clear();
+}
+
+void TextDocument::replace(int lineN, int charN, int amount, const sf::String &text) {
+    this->pendingEdits.push_back({lineN, charN, amount, text});
+}
+
+// Replacements at the same position keep the order they were given in.
+bool TextDocument::commit() {
+    std::vector<Edit> edits = std::move(this->pendingEdits);
+    this->pendingEdits.clear();
+    std::stable_sort(edits.begin(), edits.end(), [](const Edit &a, const Edit &b) {
+        return a.lineN < b.lineN || (a.lineN == b.lineN && a.charN < b.charN);
+    });
+    std::vector<std::pair<int, int>> textEnds;
+    return this->applyEdits(edits, textEnds);
+}
+
+bool TextDocument::undo(int &lineN, int &charN) {
+    if (!this->history.canUndo()) {
+        return false;
+    }
+    this->version++;
+    PieceTable::Offset cursorPos;
+    int lineCount = this->getLineCount();
+    int firstLine = INT_MAX, lastLine = -1;
+    int lineCountBefore = lineCount;
+    this->history.undo(this->buffer, cursorPos, [&](bool insertion, PieceTable::Offset pos, PieceTable::Offset amount) {
+        this->metrics.afterChange(this->buffer, insertion, pos, amount);
+        this->length = this->buffer.length();
+        this->notifyTextChanged(insertion, pos, amount, lineCountBefore);
+        this->journalChange(insertion, pos, amount);
+        this->moveMarks(insertion, pos, amount);
+        this->trackChangeAt(pos, lineCount, firstLine, lastLine);
+    }, [&](bool insertion, PieceTable::Offset pos, PieceTable::Offset amount) {
+        lineCountBefore = this->getLineCount();
+        this->metrics.beforeChange(this->buffer, insertion, pos, amount);
+    }, [&](PieceTable::Offset from, PieceTable::Offset amount, PieceTable::Offset to, int markOffset) {
+        this->moveText(from, amount, to, markOffset);
+        this->trackChangeAt(std::min(from, to), lineCount, firstLine, lastLine);
+        this->trackChangeAt(std::max(from, to) + amount, lineCount, firstLine, lastLine);
+    });
+    this->length = this->buffer.length();
+    if (lastLine >= 0) {
+        this->notifyLinesChanged(firstLine, lastLine);
+    }
+    this->getLineAndChar(cursorPos, lineN, charN);
+    return true;
+}
+
+bool TextDocument::redo(int &lineN, int &charN) {
+    if (!this->history.canRedo()) {
+        return false;
+    }
+    this->version++;
+    PieceTable::Offset cursorPos;
+    int lineCount = this->getLineCount();
+    int firstLine = INT_MAX, lastLine = -1;
+    int lineCountBefore = lineCount;
+    this->history.redo(this->buffer, cursorPos, [&](bool insertion, PieceTable::Offset pos, PieceTable::Offset amount) {
+        this->metrics.afterChange(this->buffer, insertion, pos, amount);
+        this->length = this->buffer.length();
+        this->notifyTextChanged(insertion, pos, amount, lineCountBefore);
+        this->journalChange(insertion, pos, amount);
+        this->moveMarks(insertion, pos, amount);
+        this->trackChangeAt(pos, lineCount, firstLine, lastLine);
+    }, [&](bool insertion, PieceTable::Offset pos, PieceTable::Offset amount) {
+        lineCountBefore = this->getLineCount();
+        this->metrics.beforeChange(this->buffer, insertion, pos, amount);
+    }, [&](PieceTable::Offset from, PieceTable::Offset amount, PieceTable::Offset to, int markOffset) {
+        this->moveText(from, amount, to, markOffset);
+        this->trackChangeAt(std::min(from, to), lineCount, firstLine, lastLine);
+        this->trackChangeAt(std::max(from, to) + amount, lineCount, firstLine, lastLine);
+    });
+    this->length = this->buffer.length();
+    if (lastLine >= 0) {
+        this->notifyLinesChanged(firstLine, lastLine);
+    }
+    this->getLineAndChar(cursorPos, lineN, charN);
+    return true;
+}
+
+void TextDocument::journalChange(bool insertion, PieceTable::Offset pos, PieceTable::Offset amount) {
+    if (insertion) {
+        this->journal.recordInsert(this->version, pos, this->buffer.substring(pos, amount));
+    } else {
+        this->journal.recordErase(this->version, pos, amount);
+    }
+}
+
+void TextDocument::moveMarks(bool insertion, PieceTable::Offset pos, PieceTable::Offset amount) {
+    if (insertion) {
+        this->marks.inserted(pos, amount);
+    } else {
+        this->marks.erased(pos, amount);
+    }
+}
+
+void TextDocument::addLinesChangedListener(LinesChangedListener listener) {
+    this->linesChangedListeners.push_back(std::move(listener));
+}
+
+void TextDocument::addTextChangedListener(TextChangedListener listener) {
+    this->textChangedListeners.push_back(std::move(listener));
+}
+
+// Only the line the change started on is stale, unless line breaks came or
+// went and everything below it moved.
+void TextDocument::notifyChangeAt(PieceTable::Offset pos, int lineCountBefore) {
+    int firstLine = this->buffer.lineOf(pos);
+    int lastLine = this->getLineCount() == lineCountBefore ? firstLine : DirtyLines::TO_END;
+    this->notifyLinesChanged(firstLine, lastLine);
+}
+
+// Widens firstLine..lastLine to the lines a change at `pos` touched, for
+// notifying a whole series of changes at once. Once the line count is no
+// longer lineCountBefore, the lines below the first change have moved.
+void TextDocument::trackChangeAt(PieceTable::Offset pos, int lineCountBefore, int &firstLine, int &lastLine) const {
+    int line = this->buffer.lineOf(pos);
+    firstLine = std::min(firstLine, line);
+    lastLine = std::max(lastLine, this->getLineCount() == lineCountBefore ? line : +DirtyLines::TO_END);
+}
+
+void TextDocument::notifyLinesChanged(int firstLine, int lastLine) {
+    for (const LinesChangedListener &listener : this->linesChangedListeners) {
+        listener(firstLine, lastLine);
+    }
+}
 
-    int bufferStartPos = this->getBufferPos(lineN, charN);
-    this->buffer.erase(bufferStartPos, amount);
+void TextDocument::notifyTextChanged(bool insertion, PieceTable::Offset pos, PieceTable::Offset amount,
+    int lineCountBefore) {
+    if (this->textChangedListeners.empty()) {
+        return;
+    }
+    int lineN, charN;
+    this->getLineAndChar(pos, lineN, charN);
+    int lineDelta = this->getLineCount() - lineCountBefore;
+    for (const TextChangedListener &listener : this->textChangedListeners) {
+        listener(insertion, lineN, charN, amount, lineDelta);
+    }
+}
+
+void TextDocument::beginUndoGroup() {
+    this->history.beginGroup();
+}
+
+void TextDocument::endUndoGroup() {
+    this->history.endGroup();
+}
+
+void TextDocument::breakUndoCoalescing() {
+    this->history.breakCoalescing();
+}
 
-    this->initLinebuffer();
+void TextDocument::setUndoMemoryBudget(std::size_t bytes) {
+    this->history.setMemoryBudget(bytes);
 }
 
 sf::String TextDocument::getTextFromPos(int amount, int line, int charN) {
-    int bufferPos = this->getBufferPos(line, charN);
+    PieceTable::Offset bufferPos = this->getBufferPos(line, charN);
     return this->buffer.substring(bufferPos, amount);
 }
 
@@ -130,73 +473,169 @@ int TextDocument::charAmountContained(int startLineN, int startCharN, int endLin
     return this->getBufferPos(endLineN, endCharN) - this->getBufferPos(startLineN, startCharN) + 1;
 }
 
-void TextDocument::swapLines(int lineA, int lineB) {
-    if (lineA == lineB) {
-        return;
-    }
-    this->documentHasChanged = true;
+int TextDocument::addMark(int lineN, int charN) {
+    return this->marks.add(this->getBufferPos(lineN, charN));
+}
 
-    int minLine = std::min(lineA, lineB);
-    int maxLine = std::max(lineA, lineB);
-    int lastLine = this->getLineCount() - 1;
+void TextDocument::removeMark(int mark) {
+    this->marks.remove(mark);
+}
 
-    if (minLine < 0) {
-        std::cerr << "SwapLines: Line " << minLine << " does not exist"
-                  << "\n";
+void TextDocument::setMark(int mark, int lineN, int charN) {
+    this->marks.set(mark, this->getBufferPos(lineN, charN));
+}
+
+void TextDocument::getMark(int mark, int &lineN, int &charN) {
+    this->getLineAndChar(this->marks.get(mark), lineN, charN);
+}
+
+// Lines a to c rotate: [a, b) and [b, c] trade places. A line break next to
+// them moves along with the side that moves: the one after line c, or the one
+// before line a when c is the last line. Marks go with their lines either way,
+// so a mark on a line's break stays at the end of that line.
+bool TextDocument::moveLines(int firstLine, int lastLine, int delta) {
+    int lineCount = this->getLineCount();
+    if (firstLine < 0 || firstLine > lastLine || lastLine >= lineCount ||
+        firstLine + delta < 0 || lastLine + delta >= lineCount) {
+        std::cerr << "Can't move lines " << firstLine << " to " << lastLine << " by " << delta << "\n";
+        return false;
     }
-    if (maxLine > lastLine) {
-        std::cerr << "SwapLines: Line " << lastLine << " does not exist"
-                  << "\n";
+    if (delta == 0) {
+        return true;
     }
-    if (minLine == maxLine - 1) {
-        this->swapWithNextLine(minLine);
-    } else {
-        std::cerr << "Cant swap non-contiguous lines\n";
+    int a = delta < 0 ? firstLine + delta : firstLine;
+    int b = delta < 0 ? firstLine : lastLine + 1;
+    int c = delta < 0 ? lastLine : lastLine + delta;
+
+    this->history.beginGroup();
+    // With every line taking part there is no break next to them, so one is
+    // added at the start for the time of the move.
+    int added = a == 0 && c == lineCount - 1 ? 1 : 0;
+    if (added) {
+        this->applyInsert(0, "\n");
     }
-}
 
-void TextDocument::swapWithNextLine(int line) {
-    if (line < 0 || line + 1 == this->getLineCount()) {
-        std::cerr << "Cant swap with nonexisting line: " << line << "\n";
+    PieceTable::Offset start = this->buffer.lineStart(a + added);
+    PieceTable::Offset middle = this->buffer.lineStart(b + added);
+    PieceTable::Offset end;
+    int markOffset = 0;
+    if (c + added + 1 < this->getLineCount()) {
+        end = this->buffer.lineStart(c + added + 1);
+    } else {
+        start--;
+        middle--;
+        end = this->length;
+        markOffset = 1;
+    }
+    PieceTable::Offset from = middle, amount = end - middle, to = start;
+    if (middle - start <= end - middle) {
+        from = start;
+        amount = middle - start;
+        to = end - amount;
     }
-    auto A = this->getLine(line);
-    auto B = this->getLine(line + 1);
-    int lenA = A.getSize();
-    int lenB = B.getSize();
+    this->version++;
+    this->moveText(from, amount, to, markOffset);
+    this->history.recordMove(from, amount, to, markOffset);
 
-    sf::String Z = "";
-    Z += B;
-    Z += '\n';
-    Z += A;
+    if (added) {
+        this->applyErase(0, 1);
+    }
+    this->history.endGroup();
+    this->notifyLinesChanged(a, c);
+    return true;
+}
 
-    int lineAStart = this->lineBuffer[line];
+// Cuts `amount` characters at `from` and puts the same pieces back at `to`,
+// a position in the text without them. The marks of the two stretches of
+// text trading places go along, counted markOffset characters further on.
+void TextDocument::moveText(PieceTable::Offset from, PieceTable::Offset amount, PieceTable::Offset to,
+    int markOffset) {
+    int lineCountBefore = this->getLineCount();
+    this->metrics.beforeChange(this->buffer, false, from, amount);
+    PieceTable::Span moved = this->buffer.extract(from, amount);
+    this->metrics.afterChange(this->buffer, false, from, amount);
+    this->length = this->buffer.length();
+    this->notifyTextChanged(false, from, amount, lineCountBefore);
+
+    lineCountBefore = this->getLineCount();
+    this->metrics.beforeChange(this->buffer, true, to, amount);
+    this->buffer.insert(to, std::move(moved));
+    this->metrics.afterChange(this->buffer, true, to, amount);
+    this->length = this->buffer.length();
+    this->notifyTextChanged(true, to, amount, lineCountBefore);
+
+    if (from < to) {
+        this->marks.rotated(from + markOffset, from + amount + markOffset, to + amount + markOffset);
+    } else {
+        this->marks.rotated(to + markOffset, from + markOffset, from + amount + markOffset);
+    }
+    this->journal.recordMove(this->version, from, amount, to);
+}
 
-    int totalLen = lenA + 1 + lenB;
+void TextDocument::swapLines(int lineA, int lineB) {
+    if (lineA == lineB) {
+        return;
+    }
+    int minLine = std::min(lineA, lineB);
+    int maxLine = std::max(lineA, lineB);
 
-    for (int i = 0; i < totalLen; i++) {
-        this->buffer[i + lineAStart] = Z[i];
+    if (minLine == maxLine - 1) {
+        this->moveLines(minLine, minLine, 1);
+    } else {
+        std::cerr << "Cant swap non-contiguous lines\n";
     }
-    this->lineBuffer[line + 1] = this->lineBuffer[line] + lenB + 1;
 }
 
-int TextDocument::getBufferPos(int line, int charN) {
-    if (line >= (int)this->lineBuffer.size()) {
+PieceTable::Offset TextDocument::getBufferPos(int line, int charN) const {
+    if (line >= this->getLineCount()) {
         std::cerr << "\nCan't get buffer pos of: " << line << "\n";
-        std::cerr << "Buffer last line is: " << this->lineBuffer.size() - 1 << "\n\n";
+        std::cerr << "Buffer last line is: " << this->getLineCount() - 1 << "\n\n";
     }
-    return this->lineBuffer[line] + charN;
+    return this->buffer.lineStart(line) + charN;
+}
+
+void TextDocument::getLineAndChar(PieceTable::Offset pos, int &lineN, int &charN) const {
+    lineN = this->buffer.lineOf(pos);
+    charN = pos - this->buffer.lineStart(lineN);
 }
 
 int TextDocument::charsInLine(int line) const {
-    int bufferSize = this->lineBuffer.size();
+    PieceTable::Offset lineStart = this->buffer.lineStart(line);
 
-    if (line == bufferSize - 1) {
-        return this->buffer.getSize() - this->lineBuffer[this->lineBuffer.size() - 1];
+    if (line == this->getLineCount() - 1) {
+        return this->length - lineStart;
     } else {
-        return this->lineBuffer[line + 1] - this->lineBuffer[line] - 1;
+        return this->buffer.lineStart(line + 1) - lineStart - 1;
     }
 }
 
 int TextDocument::getLineCount() const {
-    return (int)this->lineBuffer.size();
+    return this->buffer.lineCount();
+}
+
+PieceTable::Offset TextDocument::getCharCount() const {
+    return this->length;
+}
+
+// Every line break takes one byte.
+long long TextDocument::getByteCount() {
+    return this->metrics.getLineBytes() + this->getLineCount() - 1;
+}
+
+int TextDocument::getLongestLineWidth() {
+    return this->metrics.getLongestLineWidth();
+}
+
+int TextDocument::getTabWidth() const {
+    return this->tabWidth;
+}
+
+void TextDocument::setTabWidth(int tabWidth) {
+    tabWidth = std::max(1, tabWidth);
+    if (tabWidth == this->tabWidth) {
+        return;
+    }
+    this->tabWidth = tabWidth;
+    this->metrics.reset(this->buffer, tabWidth);
+    this->notifyLinesChanged(0, DirtyLines::TO_END);
 }
\ No newline at end of file
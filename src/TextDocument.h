@@ -9,42 +9,171 @@
 #include <vector>
 
 #include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 
+#include "ColumnWidth.h"
+#include "DirtyLines.h"
+#include "DocumentMetrics.h"
+#include "DocumentSnapshot.h"
+#include "EditJournal.h"
+#include "MappedFile.h"
+#include "MarkSet.h"
+#include "PieceTable.h"
 #include "SpecialChars.h"
+#include "ThreadPool.h"
+#include "UndoHistory.h"
+#include "Utf8Codec.h"
 
 using std::string;
 using std::vector;
 
 class TextDocument {
    public:
+    // Told the lines every change to the text touched. lastLine is
+    // DirtyLines::TO_END when the change moved the lines below it.
+    typedef std::function<void(int firstLine, int lastLine)> LinesChangedListener;
+    // Told every insertion (true) or erase (false) of `amount` characters
+    // right after it: (lineN, charN) is where it happened and lineDelta the
+    // lines it added, or took away when negative.
+    typedef std::function<void(bool insertion, int lineN, int charN, PieceTable::Offset amount, int lineDelta)>
+        TextChangedListener;
+
+    // One change of a batch: `amount` characters from (lineN, charN) give
+    // way to `text`.
+    struct Edit {
+        int lineN;
+        int charN;
+        int amount;
+        sf::String text;
+    };
+
+    TextDocument();
+    ~TextDocument();
+
     bool init(string &filename);
     bool saveFile(string &filename);
+    // Saves a snapshot on the shared thread pool, so editing can go on
+    // meanwhile. The document must outlive the returned future.
+    std::future<bool> saveFileInBackground(const string &filename);
     bool hasChanged();
 
+    // Every change to the text bumps the version.
+    unsigned long long getVersion() const;
+    std::shared_ptr<const DocumentSnapshot> snapshot();
+
     sf::String getLine(int lineNumber);
+    // Calls visitor(data, size) with the text of the line, without copying it.
+    void forEachRunInLine(int lineNumber, const std::function<void(const sf::Uint32 *, int)> &visitor) const;
+    // The same for `amount` characters of the line from charN.
+    void forEachRunInLine(int lineNumber, int charN, int amount,
+        const std::function<void(const sf::Uint32 *, int)> &visitor) const;
     int charsInLine(int line) const;
     int getLineCount() const;
 
+    // Kept up to date on every edit, so all of them are O(1). Right after
+    // opening a large file the last two only count edited lines for a
+    // moment, while the rest is measured in the background.
+    PieceTable::Offset getCharCount() const;
+    long long getByteCount();
+    int getLongestLineWidth();
+
+    // Columns a tab takes. Changing it counts as a change to every line.
+    int getTabWidth() const;
+    void setTabWidth(int tabWidth);
+
     void addTextToPos(sf::String text, int line, int charN);
     void removeTextFromPos(int amount, int line, int charN);
     sf::String getTextFromPos(int amount, int line, int charN);
 
+    // Applies edits given in document order, that don't overlap and whose
+    // positions are the ones before any of them, in a single pass. They are
+    // undone together and listeners hear about them once. textEnds gets the
+    // position right after the text of each edit, in the new text.
+    bool applyEdits(const std::vector<Edit> &edits, std::vector<std::pair<int, int>> &textEnds);
+    // The same as a transaction: replacements between beginEdit() and
+    // commit() may come in any order, with positions as the text was at
+    // beginEdit(), and are applied by commit().
+    void beginEdit();
+    void replace(int lineN, int charN, int amount, const sf::String &text);
+    bool commit();
+
+    // Moves lines firstLine to lastLine `delta` lines down (up when
+    // negative): the lines in the way end up on the other side. Whichever
+    // side is shorter is cut out of the piece table and put back whole, so
+    // no text is rewritten. One undo step.
+    bool moveLines(int firstLine, int lastLine, int delta);
     void swapLines(int lineA, int lineB);
 
     int charAmountContained(int startLineN, int startCharN, int endLineN, int endCharN);
+
+    // Marks are positions that every edit, undo and redo keeps pointing at
+    // the same text. A mark where text is inserted ends up after it, and the
+    // ones in erased text where it was. Moved lines take their marks along.
+    int addMark(int lineN, int charN);
+    void removeMark(int mark);
+    void setMark(int mark, int lineN, int charN);
+    void getMark(int mark, int &lineN, int &charN);
+
+    // Both leave in lineN/charN the position where the change happened.
+    bool undo(int &lineN, int &charN);
+    bool redo(int &lineN, int &charN);
+    void beginUndoGroup();
+    void endUndoGroup();
+    void breakUndoCoalescing();
+    void setUndoMemoryBudget(std::size_t bytes);
+
+    void addLinesChangedListener(LinesChangedListener listener);
+    void addTextChangedListener(TextChangedListener listener);
+
    private:
-    bool initLinebuffer();
-    sf::String buffer;
-    int length;
-    vector<int> lineBuffer;
-    bool documentHasChanged;
+    PieceTable buffer;
+    PieceTable::Offset length;
+    unsigned long long version;
+    std::atomic<unsigned long long> savedVersion;
+    // Guards the save state below and the journal against background saves.
+    std::mutex saveMutex;
+    string savedFilename;
+    // Version the current file was opened at.
+    unsigned long long loadedVersion;
+    UndoHistory history;
+    EditJournal journal;
+    DocumentMetrics metrics;
+    MarkSet marks;
+    int tabWidth;
+    std::vector<LinesChangedListener> linesChangedListeners;
+    std::vector<TextChangedListener> textChangedListeners;
+    std::vector<Edit> pendingEdits;
+
+    std::shared_ptr<const DocumentSnapshot> snapshotToSave();
+    bool save(const DocumentSnapshot &documentSnapshot, const string &filename);
+    void markSaved(const string &filename, unsigned long long savedAt);
+    void recoverJournal(const string &filename);
+    void journalChange(bool insertion, PieceTable::Offset pos, PieceTable::Offset amount);
+    void moveMarks(bool insertion, PieceTable::Offset pos, PieceTable::Offset amount);
+    void notifyChangeAt(PieceTable::Offset pos, int lineCountBefore);
+    void trackChangeAt(PieceTable::Offset pos, int lineCountBefore, int &firstLine, int &lastLine) const;
+    void notifyLinesChanged(int firstLine, int lastLine);
+    void notifyTextChanged(bool insertion, PieceTable::Offset pos, PieceTable::Offset amount, int lineCountBefore);
+
+    PieceTable::Offset getBufferPos(int line, int charN) const;
+    void getLineAndChar(PieceTable::Offset pos, int &lineN, int &charN) const;
 
-    int getBufferPos(int line, int charN);
+    void insertAt(PieceTable::Offset pos, const sf::String &text);
+    void eraseAt(PieceTable::Offset pos, PieceTable::Offset amount);
+    // insertAt and eraseAt without telling the lines changed listeners.
+    void applyInsert(PieceTable::Offset pos, const sf::String &text);
+    PieceTable::Offset applyErase(PieceTable::Offset pos, PieceTable::Offset amount);
 
-    void swapWithNextLine(int line);
+    // Leaves the version and the history to the caller.
+    void moveText(PieceTable::Offset from, PieceTable::Offset amount, PieceTable::Offset to, int markOffset);
 
-    sf::String toUtf32(const std::string &inString);
+    static sf::String toUtf32(const std::string &inString);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(int threadCount) : stopping(false) {
+    if (threadCount <= 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        this->workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->tasksMutex);
+        this->stopping = true;
+    }
+    this->tasksAvailable.notify_all();
+    for (std::thread &worker : this->workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::getThreadCount() const {
+    return this->workers.size();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(this->tasksMutex);
+        this->tasks.push_back(std::move(task));
+    }
+    this->tasksAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &body) {
+    if (count <= 0) {
+        return;
+    }
+
+    struct Job {
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto job = std::make_shared<Job>();
+
+    auto run = [job, count, &body]() {
+        int finishedHere = 0;
+        for (int i = job->next++; i < count; i = job->next++) {
+            body(i);
+            finishedHere++;
+        }
+        if (finishedHere > 0 && (job->done += finishedHere) == count) {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->finished.notify_all();
+        }
+    };
+
+    int helpers = std::min(count, (int)this->workers.size()) - 1;
+    for (int i = 0; i < helpers; i++) {
+        this->submit(run);
+    }
+    run();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&]() { return job->done == count; });
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(this->tasksMutex);
+            this->tasksAvailable.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+            if (this->stopping && this->tasks.empty()) {
+                return;
+            }
+            task = std::move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef ThreadPool_H
+#define ThreadPool_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for background and data-parallel work.
+class ThreadPool {
+   public:
+    // threadCount <= 0 uses one worker per hardware thread.
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int getThreadCount() const;
+
+    void submit(std::function<void()> task);
+
+    // Runs body(0) .. body(count - 1) on the workers and the calling thread,
+    // returning once every call has finished.
+    void parallelFor(int count, const std::function<void(int)> &body);
+
+    static ThreadPool &shared();
+
+   private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable tasksAvailable;
+    bool stopping;
+
+    void workerLoop();
+};
+
+#endif
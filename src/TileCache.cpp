@@ -0,0 +1,102 @@
+#include "TileCache.h"
+
+#include <algorithm>
+#include <iostream>
+
+constexpr std::pair<int, int> FREE_SLOT(-1, -1);
+
+TileCache::TileCache() : tileWidth(1), tileHeight(1), slotsPerRow(0), frame(0) {}
+
+void TileCache::reset(int tileWidth, int tileHeight) {
+    this->tiles.clear();
+    this->slotOwners.clear();
+    this->tileWidth = std::max(1, tileWidth);
+    this->tileHeight = std::max(1, tileHeight);
+
+    unsigned atlasSize = sf::Texture::getMaximumSize();
+    if (atlasSize > ATLAS_MAX_SIZE) {
+        atlasSize = ATLAS_MAX_SIZE;
+    }
+    this->slotsPerRow = atlasSize / this->tileWidth;
+    int slotRows = atlasSize / this->tileHeight;
+    if (this->slotsPerRow == 0 || slotRows == 0) {
+        return;
+    }
+
+    this->atlas = std::make_unique<sf::RenderTexture>();
+    if (!this->atlas->create(this->slotsPerRow * this->tileWidth, slotRows * this->tileHeight)) {
+        std::cerr << "Can't create the text tile atlas, text won't be cached" << std::endl;
+        return;
+    }
+    this->atlas->setSmooth(true);
+    this->slotOwners.assign(this->slotsPerRow * slotRows, FREE_SLOT);
+}
+
+int TileCache::getTileWidth() const {
+    return this->tileWidth;
+}
+
+int TileCache::getTileHeight() const {
+    return this->tileHeight;
+}
+
+void TileCache::beginFrame() {
+    this->frame++;
+}
+
+TileCache::Tile *TileCache::acquire(int row, int column) {
+    std::pair<int, int> key(row, column);
+    auto it = this->tiles.find(key);
+    if (it == this->tiles.end()) {
+        int slot = this->takeSlot();
+        if (slot < 0) {
+            return nullptr;
+        }
+
+        Tile tile;
+        tile.row = row;
+        tile.column = column;
+        tile.slot = slot;
+        tile.generation = 0;
+        it = this->tiles.emplace(key, tile).first;
+        this->slotOwners[slot] = key;
+    }
+
+    Tile &tile = it->second;
+    tile.lastUse = this->frame;
+    return &tile;
+}
+
+sf::RenderTexture &TileCache::getAtlas() {
+    return *this->atlas;
+}
+
+sf::IntRect TileCache::getSlotRect(const Tile &tile) const {
+    return sf::IntRect(
+        (tile.slot % this->slotsPerRow) * this->tileWidth,
+        (tile.slot / this->slotsPerRow) * this->tileHeight,
+        this->tileWidth, this->tileHeight);
+}
+
+// A free slot, or the one of the least recently used tile that isn't part of
+// the current frame.
+int TileCache::takeSlot() {
+    int victim = -1;
+    unsigned long long oldestUse = this->frame;
+    for (int slot = 0; slot < (int)this->slotOwners.size(); slot++) {
+        if (this->slotOwners[slot] == FREE_SLOT) {
+            return slot;
+        }
+        const Tile &tile = this->tiles.at(this->slotOwners[slot]);
+        if (tile.lastUse < oldestUse) {
+            oldestUse = tile.lastUse;
+            victim = slot;
+        }
+    }
+
+    if (victim >= 0) {
+        this->tiles.erase(this->slotOwners[victim]);
+        this->slotOwners[victim] = FREE_SLOT;
+    }
+    return victim;
+}
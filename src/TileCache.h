@@ -0,0 +1,62 @@
+#ifndef TileCache_H
+#define TileCache_H
+
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Rendered text kept on the GPU between frames. The document is cut in tiles
+// of TILE_LINES lines by TILE_COLUMNS columns, and each rendered tile lives in
+// a slot of one atlas texture, so every cached tile on screen is composited
+// with a single draw call. Only used on the render thread.
+class TileCache {
+   public:
+    struct Tile {
+        int row;
+        int column;
+        int slot;
+        // TileContent::generation rastered in the slot, 0 before the first.
+        unsigned long long generation;
+        unsigned long long lastUse;
+    };
+
+    TileCache();
+
+    // Drops every tile. From now on tiles are tileWidth x tileHeight pixels,
+    // which happens whenever the font size changes.
+    void reset(int tileWidth, int tileHeight);
+    int getTileWidth() const;
+    int getTileHeight() const;
+
+    // Tiles touched before the next call count as used in the same frame and
+    // are never evicted to make room for each other.
+    void beginFrame();
+
+    // Tile at (row, column) with its slot in the atlas. Returns nullptr when
+    // all slots hold tiles of the current frame.
+    Tile *acquire(int row, int column);
+
+    sf::RenderTexture &getAtlas();
+    sf::IntRect getSlotRect(const Tile &tile) const;
+
+    static const int TILE_LINES = 16;
+    static const int TILE_COLUMNS = 64;
+    static const unsigned ATLAS_MAX_SIZE = 4096;
+
+   private:
+    std::unique_ptr<sf::RenderTexture> atlas;
+    int tileWidth;
+    int tileHeight;
+    int slotsPerRow;
+
+    std::map<std::pair<int, int>, Tile> tiles;
+    // Tile in each slot, (-1, -1) for a free one.
+    std::vector<std::pair<int, int>> slotOwners;
+    unsigned long long frame;
+
+    int takeSlot();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef TripleBuffer_H
+#define TripleBuffer_H
+
+#include <atomic>
+
+// Hands values from one producer thread to one consumer thread without
+// locks. The producer fills getWriteBuffer() and publishes it; the consumer
+// fetches the latest published value into getReadBuffer(). Values published
+// in between are skipped, and neither side ever waits for the other.
+template <typename T>
+class TripleBuffer {
+   public:
+    TripleBuffer() : middle(1), writeIndex(0), readIndex(2) {}
+
+    TripleBuffer(const TripleBuffer &) = delete;
+    TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+    T &getWriteBuffer() {
+        return this->slots[this->writeIndex];
+    }
+
+    // Swaps the written slot with the middle one and flags it as fresh.
+    void publish() {
+        int previous = this->middle.exchange(this->writeIndex | FRESH, std::memory_order_acq_rel);
+        this->writeIndex = previous & INDEX_MASK;
+    }
+
+    // Takes the middle slot if something was published since the last
+    // fetch. Returns whether getReadBuffer() changed.
+    bool fetch() {
+        if (!(this->middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        int previous = this->middle.exchange(this->readIndex, std::memory_order_acq_rel);
+        this->readIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T &getReadBuffer() const {
+        return this->slots[this->readIndex];
+    }
+
+   private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;
+
+    T slots[3];
+    // Index of the middle slot, plus FRESH when it holds an unread value.
+    std::atomic<int> middle;
+    int writeIndex;
+    int readIndex;
+};
+
+#endif
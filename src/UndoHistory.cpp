@@ -0,0 +1,274 @@
+#include "UndoHistory.h"
+
+UndoHistory::Entry::Entry() : bytes(0) {}
+
+UndoHistory::UndoHistory()
+    : groupDepth(0), groupStarted(false), coalescing(false), memoryUsage(0),
+      memoryBudget(DEFAULT_MEMORY_BUDGET), droppedBytes(0) {}
+
+void UndoHistory::clear() {
+    this->undoStack.clear();
+    this->redoStack.clear();
+    this->groupStarted = false;
+    this->coalescing = false;
+    this->memoryUsage = 0;
+    this->droppedBytes = 0;
+}
+
+void UndoHistory::recordInsert(PieceTable::Offset pos, PieceTable::Offset amount, bool canCoalesce) {
+    if (amount <= 0) {
+        return;
+    }
+
+    // Keep extending the last insertion while the user types one character
+    // after the other.
+    if (canCoalesce && this->coalescing && this->groupDepth == 0 && !this->undoStack.empty()) {
+        Entry &last = this->undoStack.back();
+        Operation &previous = last.operations.back();
+        if (last.operations.size() == 1 && previous.insertion &&
+            previous.pos + previous.amount == pos) {
+            previous.amount += amount;
+            return;
+        }
+    }
+
+    Operation operation;
+    operation.insertion = true;
+    operation.move = false;
+    operation.pos = pos;
+    operation.amount = amount;
+    this->record(std::move(operation));
+    this->coalescing = canCoalesce;
+}
+
+void UndoHistory::recordErase(PieceTable::Offset pos, PieceTable::Span removed) {
+    if (removed.length() <= 0) {
+        return;
+    }
+
+    Operation operation;
+    operation.insertion = false;
+    operation.move = false;
+    operation.pos = pos;
+    operation.amount = removed.length();
+    operation.removed = std::move(removed);
+    this->record(std::move(operation));
+    this->coalescing = false;
+}
+
+void UndoHistory::recordMove(PieceTable::Offset from, PieceTable::Offset amount, PieceTable::Offset to,
+    int markOffset) {
+    if (amount <= 0 || from == to) {
+        return;
+    }
+
+    Operation operation;
+    operation.insertion = false;
+    operation.move = true;
+    operation.pos = from;
+    operation.amount = amount;
+    operation.to = to;
+    operation.markOffset = markOffset;
+    this->record(std::move(operation));
+    this->coalescing = false;
+}
+
+void UndoHistory::beginGroup() {
+    if (this->groupDepth++ == 0) {
+        this->groupStarted = false;
+    }
+}
+
+void UndoHistory::endGroup() {
+    if (this->groupDepth > 0 && --this->groupDepth == 0) {
+        this->groupStarted = false;
+        this->enforceBudget();
+    }
+}
+
+void UndoHistory::breakCoalescing() {
+    this->coalescing = false;
+}
+
+bool UndoHistory::undo(PieceTable &buffer, PieceTable::Offset &cursorPos, const ChangeListener &onChange,
+    const ChangeListener &beforeChange, const Mover &mover) {
+    if (this->undoStack.empty()) {
+        return false;
+    }
+    this->coalescing = false;
+
+    Entry entry = std::move(this->undoStack.back());
+    this->undoStack.pop_back();
+
+    for (auto it = entry.operations.rbegin(); it != entry.operations.rend(); ++it) {
+        if (it->move) {
+            move(buffer, *it, true, mover);
+            cursorPos = it->pos;
+            continue;
+        }
+        revert(buffer, *it, onChange, beforeChange);
+        cursorPos = it->insertion ? it->pos : it->pos + it->amount;
+    }
+
+    this->updateBytes(entry);
+    this->redoStack.push_back(std::move(entry));
+    return true;
+}
+
+bool UndoHistory::redo(PieceTable &buffer, PieceTable::Offset &cursorPos, const ChangeListener &onChange,
+    const ChangeListener &beforeChange, const Mover &mover) {
+    if (this->redoStack.empty()) {
+        return false;
+    }
+    this->coalescing = false;
+
+    Entry entry = std::move(this->redoStack.back());
+    this->redoStack.pop_back();
+
+    for (Operation &operation : entry.operations) {
+        if (operation.move) {
+            move(buffer, operation, false, mover);
+            cursorPos = operation.to;
+            continue;
+        }
+        apply(buffer, operation, onChange, beforeChange);
+        cursorPos = operation.insertion ? operation.pos + operation.amount : operation.pos;
+    }
+
+    this->updateBytes(entry);
+    this->undoStack.push_back(std::move(entry));
+    return true;
+}
+
+bool UndoHistory::canUndo() const {
+    return !this->undoStack.empty();
+}
+
+bool UndoHistory::canRedo() const {
+    return !this->redoStack.empty();
+}
+
+void UndoHistory::setMemoryBudget(std::size_t bytes) {
+    this->memoryBudget = bytes;
+    this->enforceBudget();
+}
+
+void UndoHistory::setDropListener(DropListener listener) {
+    this->dropListener = std::move(listener);
+}
+
+std::size_t UndoHistory::getMemoryUsage() const {
+    return this->memoryUsage;
+}
+
+void UndoHistory::record(Operation operation) {
+    for (const Entry &entry : this->redoStack) {
+        this->drop(entry);
+    }
+    this->redoStack.clear();
+
+    if (this->groupDepth == 0 || !this->groupStarted) {
+        this->undoStack.emplace_back();
+        this->groupStarted = this->groupDepth > 0;
+    }
+
+    Entry &entry = this->undoStack.back();
+    std::size_t bytes = bytesOf(operation);
+    entry.operations.push_back(std::move(operation));
+    entry.bytes += bytes;
+    this->memoryUsage += bytes;
+
+    if (this->groupDepth == 0) {
+        this->enforceBudget();
+    }
+}
+
+// The newest entry always survives, so the last edit can be undone even if it
+// is bigger than the whole budget. Looking for text nobody holds any more
+// walks every piece, so it waits until a quarter of the budget was dropped.
+void UndoHistory::enforceBudget() {
+    while (this->memoryUsage > this->memoryBudget && !this->redoStack.empty()) {
+        this->drop(this->redoStack.front());
+        this->redoStack.erase(this->redoStack.begin());
+    }
+    while (this->memoryUsage > this->memoryBudget && this->undoStack.size() > 1) {
+        this->drop(this->undoStack.front());
+        this->undoStack.pop_front();
+    }
+
+    if (this->droppedBytes == 0 || this->droppedBytes < this->memoryBudget / 4 || !this->dropListener) {
+        return;
+    }
+    this->droppedBytes = 0;
+    std::vector<const PieceTable::Span *> kept;
+    for (const Entry &entry : this->undoStack) {
+        for (const Operation &operation : entry.operations) {
+            kept.push_back(&operation.removed);
+        }
+    }
+    for (const Entry &entry : this->redoStack) {
+        for (const Operation &operation : entry.operations) {
+            kept.push_back(&operation.removed);
+        }
+    }
+    this->dropListener(kept);
+}
+
+void UndoHistory::drop(const Entry &entry) {
+    this->memoryUsage -= entry.bytes;
+    this->droppedBytes += entry.bytes;
+}
+
+void UndoHistory::updateBytes(Entry &entry) {
+    this->memoryUsage -= entry.bytes;
+    entry.bytes = 0;
+    for (const Operation &operation : entry.operations) {
+        entry.bytes += bytesOf(operation);
+    }
+    this->memoryUsage += entry.bytes;
+}
+
+void UndoHistory::revert(PieceTable &buffer, Operation &operation, const ChangeListener &onChange,
+    const ChangeListener &beforeChange) {
+    if (beforeChange) {
+        beforeChange(!operation.insertion, operation.pos, operation.amount);
+    }
+    if (operation.insertion) {
+        operation.removed = buffer.extract(operation.pos, operation.amount);
+    } else {
+        buffer.insert(operation.pos, std::move(operation.removed));
+    }
+    if (onChange) {
+        onChange(!operation.insertion, operation.pos, operation.amount);
+    }
+}
+
+void UndoHistory::apply(PieceTable &buffer, Operation &operation, const ChangeListener &onChange,
+    const ChangeListener &beforeChange) {
+    if (beforeChange) {
+        beforeChange(operation.insertion, operation.pos, operation.amount);
+    }
+    if (operation.insertion) {
+        buffer.insert(operation.pos, std::move(operation.removed));
+    } else {
+        operation.removed = buffer.extract(operation.pos, operation.amount);
+    }
+    if (onChange) {
+        onChange(operation.insertion, operation.pos, operation.amount);
+    }
+}
+
+// Back is the undo direction, from `to` to pos.
+void UndoHistory::move(PieceTable &buffer, const Operation &operation, bool back, const Mover &mover) {
+    PieceTable::Offset from = back ? operation.to : operation.pos;
+    PieceTable::Offset to = back ? operation.pos : operation.to;
+    if (mover) {
+        mover(from, operation.amount, to, operation.markOffset);
+    } else {
+        buffer.insert(to, buffer.extract(from, operation.amount));
+    }
+}
+
+std::size_t UndoHistory::bytesOf(const Operation &operation) {
+    return sizeof(Operation) + operation.removed.memoryUsage();
+}
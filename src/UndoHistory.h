@@ -0,0 +1,107 @@
+#ifndef UndoHistory_H
+#define UndoHistory_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "PieceTable.h"
+
+// Undo/redo log of piece table edits. An entry stores the inverse of what was
+// done: an insertion only remembers where it went, an erase keeps the pieces
+// it cut out, a move remembers where the text came from. Undoing or redoing
+// moves pieces in and out of the table, so it costs the same as the original
+// edit whatever the document size.
+class UndoHistory {
+   public:
+    // Told about every insertion (true) or erase (false) of `amount`
+    // characters at `pos` that undo() or redo() makes, right after it (or
+    // right before it, for beforeChange).
+    typedef std::function<void(bool insertion, PieceTable::Offset pos, PieceTable::Offset amount)> ChangeListener;
+    // Makes a move that undo() or redo() comes across: `amount` characters
+    // at `from` go to `to`, a position in the text without them. markOffset
+    // is the one it was recorded with. Without one, the pieces are just moved.
+    typedef std::function<void(PieceTable::Offset from, PieceTable::Offset amount, PieceTable::Offset to,
+        int markOffset)> Mover;
+    // Told, once a good part of the budget's worth of entries was dropped,
+    // about every span the history still holds, so the text only the dropped
+    // ones held can be let go.
+    typedef std::function<void(const std::vector<const PieceTable::Span *> &kept)> DropListener;
+
+    UndoHistory();
+
+    void clear();
+
+    // `canCoalesce` lets a one character insertion join the previous one
+    // (typing a word becomes a single entry).
+    void recordInsert(PieceTable::Offset pos, PieceTable::Offset amount, bool canCoalesce);
+    void recordErase(PieceTable::Offset pos, PieceTable::Span removed);
+    void recordMove(PieceTable::Offset from, PieceTable::Offset amount, PieceTable::Offset to, int markOffset);
+
+    // Everything recorded between these calls is undone as a single entry.
+    void beginGroup();
+    void endGroup();
+    void breakCoalescing();
+
+    // On success cursorPos is where the change happened.
+    bool undo(PieceTable &buffer, PieceTable::Offset &cursorPos, const ChangeListener &onChange = nullptr,
+        const ChangeListener &beforeChange = nullptr, const Mover &mover = nullptr);
+    bool redo(PieceTable &buffer, PieceTable::Offset &cursorPos, const ChangeListener &onChange = nullptr,
+        const ChangeListener &beforeChange = nullptr, const Mover &mover = nullptr);
+    bool canUndo() const;
+    bool canRedo() const;
+
+    // Oldest entries are dropped while the history uses more than this,
+    // counting the text their spans keep alive.
+    void setMemoryBudget(std::size_t bytes);
+    void setDropListener(DropListener listener);
+    std::size_t getMemoryUsage() const;
+
+    static const std::size_t DEFAULT_MEMORY_BUDGET = 64 << 20;
+
+   private:
+    // `removed` holds the pieces while they are out of the table: the erased
+    // text of an applied erase, or the inserted text of an undone insertion.
+    // A move keeps none; its text is always in the table, at pos or at `to`.
+    struct Operation {
+        bool insertion;
+        bool move;
+        PieceTable::Offset pos;
+        PieceTable::Offset amount;
+        PieceTable::Offset to;
+        int markOffset;
+        PieceTable::Span removed;
+    };
+
+    struct Entry {
+        Entry();
+
+        std::vector<Operation> operations;
+        std::size_t bytes;
+    };
+
+    std::deque<Entry> undoStack;
+    std::vector<Entry> redoStack;
+    int groupDepth;
+    bool groupStarted;
+    bool coalescing;
+    std::size_t memoryUsage;
+    std::size_t memoryBudget;
+    std::size_t droppedBytes;
+    DropListener dropListener;
+
+    void record(Operation operation);
+    void enforceBudget();
+    void drop(const Entry &entry);
+    void updateBytes(Entry &entry);
+
+    static void revert(PieceTable &buffer, Operation &operation, const ChangeListener &onChange,
+        const ChangeListener &beforeChange);
+    static void apply(PieceTable &buffer, Operation &operation, const ChangeListener &onChange,
+        const ChangeListener &beforeChange);
+    static void move(PieceTable &buffer, const Operation &operation, bool back, const Mover &mover);
+    static std::size_t bytesOf(const Operation &operation);
+};
+
+#endif
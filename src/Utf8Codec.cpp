@@ -0,0 +1,464 @@
+#include "Utf8Codec.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UTF8CODEC_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8CODEC_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Utf8Codec {
+
+namespace {
+
+inline int popCount(std::uint32_t mask) {
+#ifdef _MSC_VER
+    return __popcnt(mask);
+#else
+    return __builtin_popcount(mask);
+#endif
+}
+
+inline int lowestBit(std::uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline bool isLineBreak(std::uint32_t c) {
+    return c == '\n' || c == 13;
+}
+
+// Decodes the sequence starting at `p`, returning how many bytes it used.
+// Overlong forms, surrogates, truncated and out of range sequences consume a
+// single byte and produce REPLACEMENT_CHAR.
+inline int decodeSequence(const unsigned char *p, const unsigned char *end, std::uint32_t &out) {
+    unsigned lead = p[0];
+    if (lead < 0x80) {
+        out = lead;
+        return 1;
+    }
+
+    int length;
+    std::uint32_t codePoint;
+    std::uint32_t minimum;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        codePoint = lead & 0x1F;
+        minimum = 0x80;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        codePoint = lead & 0x0F;
+        minimum = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        codePoint = lead & 0x07;
+        minimum = 0x10000;
+    } else {
+        out = REPLACEMENT_CHAR;
+        return 1;
+    }
+
+    if (end - p < length) {
+        out = REPLACEMENT_CHAR;
+        return 1;
+    }
+    for (int i = 1; i < length; i++) {
+        unsigned continuation = p[i];
+        if ((continuation & 0xC0) != 0x80) {
+            out = REPLACEMENT_CHAR;
+            return 1;
+        }
+        codePoint = (codePoint << 6) | (continuation & 0x3F);
+    }
+    if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+        out = REPLACEMENT_CHAR;
+        return 1;
+    }
+    out = codePoint;
+    return length;
+}
+
+#if defined(UTF8CODEC_AVX2)
+
+const int BLOCK = 32;
+
+// Bit i of the returned masks is set when byte i is non-ASCII / a '\n' / a
+// '\r'.
+inline void classifyBlock(const unsigned char *p, std::uint32_t &nonAscii, std::uint32_t &lineFeeds,
+    std::uint32_t &returns) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    nonAscii = (std::uint32_t)_mm256_movemask_epi8(block);
+    lineFeeds = (std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')));
+    returns = (std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(13)));
+}
+
+inline void widenBlock(const unsigned char *p, std::uint8_t *out) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+}
+
+inline void widenBlock(const unsigned char *p, std::uint16_t *out) {
+    for (int i = 0; i < BLOCK; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_cvtepu8_epi16(bytes));
+    }
+}
+
+inline void widenBlock(const unsigned char *p, std::uint32_t *out) {
+    for (int i = 0; i < BLOCK; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_cvtepu8_epi32(bytes));
+    }
+}
+
+// Bit i is set when byte i starts a sequence (is not a continuation byte).
+inline std::uint32_t leadBlock(const unsigned char *p) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i continuation = _mm256_cmpeq_epi8(
+        _mm256_and_si256(block, _mm256_set1_epi8((char)0xC0)), _mm256_set1_epi8((char)0x80));
+    return ~(std::uint32_t)_mm256_movemask_epi8(continuation);
+}
+
+// Stores the low byte of 32 code points and returns a mask with bit i set
+// when code point i is not ASCII (its stored byte is then meaningless).
+inline std::uint32_t narrowBlock(const std::uint32_t *p, unsigned char *out) {
+    const __m256i *in = reinterpret_cast<const __m256i *>(p);
+    __m256i a = _mm256_loadu_si256(in);
+    __m256i b = _mm256_loadu_si256(in + 1);
+    __m256i c = _mm256_loadu_si256(in + 2);
+    __m256i d = _mm256_loadu_si256(in + 3);
+
+    __m256i highBits = _mm256_set1_epi32(~0x7F);
+    __m256i zero = _mm256_setzero_si256();
+    std::uint32_t ascii = 0;
+    ascii |= (std::uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_and_si256(a, highBits), zero)));
+    ascii |= (std::uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_and_si256(b, highBits), zero))) << 8;
+    ascii |= (std::uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_and_si256(c, highBits), zero))) << 16;
+    ascii |= (std::uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_and_si256(d, highBits), zero))) << 24;
+
+    // The packs work per 128-bit lane; the permutation puts the dwords back
+    // in order.
+    __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+    bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), bytes);
+    return ~ascii;
+}
+
+#elif defined(UTF8CODEC_SSE2)
+
+const int BLOCK = 16;
+
+inline void classifyBlock(const unsigned char *p, std::uint32_t &nonAscii, std::uint32_t &lineFeeds,
+    std::uint32_t &returns) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    nonAscii = (std::uint32_t)_mm_movemask_epi8(block);
+    lineFeeds = (std::uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+    returns = (std::uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(13)));
+}
+
+inline void widenBlock(const unsigned char *p, std::uint8_t *out) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+inline void widenBlock(const unsigned char *p, std::uint16_t *out) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(block, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(block, zero));
+}
+
+inline void widenBlock(const unsigned char *p, std::uint32_t *out) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i low = _mm_unpacklo_epi8(block, zero);
+    __m128i high = _mm_unpackhi_epi8(block, zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi16(low, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4), _mm_unpackhi_epi16(low, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpacklo_epi16(high, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 12), _mm_unpackhi_epi16(high, zero));
+}
+
+inline std::uint32_t leadBlock(const unsigned char *p) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i continuation = _mm_cmpeq_epi8(
+        _mm_and_si128(block, _mm_set1_epi8((char)0xC0)), _mm_set1_epi8((char)0x80));
+    return ~(std::uint32_t)_mm_movemask_epi8(continuation) & 0xFFFF;
+}
+
+inline std::uint32_t narrowBlock(const std::uint32_t *p, unsigned char *out) {
+    const __m128i *in = reinterpret_cast<const __m128i *>(p);
+    __m128i a = _mm_loadu_si128(in);
+    __m128i b = _mm_loadu_si128(in + 1);
+    __m128i c = _mm_loadu_si128(in + 2);
+    __m128i d = _mm_loadu_si128(in + 3);
+
+    __m128i highBits = _mm_set1_epi32(~0x7F);
+    __m128i zero = _mm_setzero_si128();
+    std::uint32_t ascii = 0;
+    ascii |= (std::uint32_t)_mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpeq_epi32(_mm_and_si128(a, highBits), zero)));
+    ascii |= (std::uint32_t)_mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpeq_epi32(_mm_and_si128(b, highBits), zero))) << 4;
+    ascii |= (std::uint32_t)_mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpeq_epi32(_mm_and_si128(c, highBits), zero))) << 8;
+    ascii |= (std::uint32_t)_mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpeq_epi32(_mm_and_si128(d, highBits), zero))) << 12;
+
+    __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), bytes);
+    return ~ascii & 0xFFFF;
+}
+
+#else
+
+const int BLOCK = 8;
+
+inline void classifyBlock(const unsigned char *p, std::uint32_t &nonAscii, std::uint32_t &lineFeeds,
+    std::uint32_t &returns) {
+    nonAscii = 0;
+    lineFeeds = 0;
+    returns = 0;
+    for (int i = 0; i < BLOCK; i++) {
+        nonAscii |= (std::uint32_t)(p[i] >> 7) << i;
+        lineFeeds |= (std::uint32_t)(p[i] == '\n') << i;
+        returns |= (std::uint32_t)(p[i] == 13) << i;
+    }
+}
+
+template <typename Unit>
+inline void widenBlock(const unsigned char *p, Unit *out) {
+    for (int i = 0; i < BLOCK; i++) {
+        out[i] = p[i];
+    }
+}
+
+inline std::uint32_t leadBlock(const unsigned char *p) {
+    std::uint32_t leads = 0;
+    for (int i = 0; i < BLOCK; i++) {
+        leads |= (std::uint32_t)((p[i] & 0xC0) != 0x80) << i;
+    }
+    return leads;
+}
+
+inline std::uint32_t narrowBlock(const std::uint32_t *p, unsigned char *out) {
+    std::uint32_t nonAscii = 0;
+    for (int i = 0; i < BLOCK; i++) {
+        out[i] = (unsigned char)p[i];
+        nonAscii |= (std::uint32_t)(p[i] >= 0x80) << i;
+    }
+    return nonAscii;
+}
+
+#endif
+
+// Whether the byte at `p` is the '\r' of a "\r\n" pair, which is read as the
+// '\n' alone so the pair is a single line break.
+inline bool isPairedReturn(const unsigned char *p, const unsigned char *end) {
+    return p[0] == 13 && end - p > 1 && p[1] == '\n';
+}
+
+// Bit i is set when byte i of the block at `p` is the '\r' of a pair.
+inline std::uint32_t pairedReturns(const unsigned char *p, const unsigned char *end, std::uint32_t lineFeeds,
+    std::uint32_t returns) {
+    std::uint32_t paired = returns & (lineFeeds >> 1);
+    if (isPairedReturn(p + BLOCK - 1, end)) {
+        paired |= 1u << (BLOCK - 1);
+    }
+    return paired;
+}
+
+// Writes one code point, replacing surrogates and values past U+10FFFF.
+inline int encodeSequence(std::uint32_t codePoint, unsigned char *out) {
+    if (codePoint < 0x80) {
+        out[0] = (unsigned char)codePoint;
+        return 1;
+    }
+    if (codePoint < 0x800) {
+        out[0] = (unsigned char)(0xC0 | (codePoint >> 6));
+        out[1] = (unsigned char)(0x80 | (codePoint & 0x3F));
+        return 2;
+    }
+    if (codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+        codePoint = REPLACEMENT_CHAR;
+    }
+    if (codePoint < 0x10000) {
+        out[0] = (unsigned char)(0xE0 | (codePoint >> 12));
+        out[1] = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out[2] = (unsigned char)(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    out[0] = (unsigned char)(0xF0 | (codePoint >> 18));
+    out[1] = (unsigned char)(0x80 | ((codePoint >> 12) & 0x3F));
+    out[2] = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+    out[3] = (unsigned char)(0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+}  // namespace
+
+Counts count(const char *bytes, int size) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(bytes);
+    const unsigned char *end = p + size;
+    Counts counts{0, 0, 0, 0};
+
+    while (p < end) {
+        if (end - p >= BLOCK) {
+            std::uint32_t nonAscii, lineFeeds, returns;
+            classifyBlock(p, nonAscii, lineFeeds, returns);
+            std::uint32_t breaks = lineFeeds | returns;
+            std::uint32_t special = nonAscii | pairedReturns(p, end, lineFeeds, returns);
+            if (special == 0) {
+                counts.chars += BLOCK;
+                counts.lineFeeds += popCount(breaks);
+                p += BLOCK;
+                continue;
+            }
+            int asciiPrefix = lowestBit(special);
+            counts.chars += asciiPrefix;
+            counts.lineFeeds += popCount(breaks & ((1u << asciiPrefix) - 1));
+            p += asciiPrefix;
+        }
+
+        if (isPairedReturn(p, end)) {
+            p++;
+            continue;
+        }
+        std::uint32_t codePoint;
+        int used = decodeSequence(p, end, codePoint);
+        counts.malformed += codePoint == REPLACEMENT_CHAR && used == 1;
+        p += used;
+        counts.chars++;
+        counts.lineFeeds += isLineBreak(codePoint);
+        counts.maxCodePoint = std::max(counts.maxCodePoint, codePoint);
+    }
+    return counts;
+}
+
+template <typename Container>
+void decode(const char *bytes, int size, Container &out, std::vector<int> &lineBreaks) {
+    typedef typename Container::value_type Unit;
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(bytes);
+    const unsigned char *end = p + size;
+
+    // Never more code points than bytes: write through a raw pointer and trim.
+    std::size_t base = out.size();
+    out.resize(base + size + BLOCK);
+    Unit *write = &out[base];
+    Unit *writeStart = write;
+
+    while (p < end) {
+        if (end - p >= BLOCK) {
+            std::uint32_t nonAscii, lineFeeds, returns;
+            classifyBlock(p, nonAscii, lineFeeds, returns);
+            std::uint32_t breaks = lineFeeds | returns;
+            std::uint32_t special = nonAscii | pairedReturns(p, end, lineFeeds, returns);
+            int asciiCount = special == 0 ? BLOCK : lowestBit(special);
+            if (asciiCount > 0) {
+                widenBlock(p, write);
+                std::uint32_t asciiBreaks = asciiCount == 32 ? breaks : breaks & ((1u << asciiCount) - 1);
+                int position = base + (write - writeStart);
+                while (asciiBreaks) {
+                    lineBreaks.push_back(position + lowestBit(asciiBreaks));
+                    asciiBreaks &= asciiBreaks - 1;
+                }
+                write += asciiCount;
+                p += asciiCount;
+                continue;
+            }
+        }
+
+        if (isPairedReturn(p, end)) {
+            p++;
+            continue;
+        }
+        std::uint32_t codePoint;
+        p += decodeSequence(p, end, codePoint);
+        if (isLineBreak(codePoint)) {
+            lineBreaks.push_back(base + (write - writeStart));
+        }
+        *write++ = (Unit)codePoint;
+    }
+    out.resize(base + (write - writeStart));
+}
+
+template void decode(const char *, int, std::vector<std::uint8_t> &, std::vector<int> &);
+template void decode(const char *, int, std::vector<std::uint16_t> &, std::vector<int> &);
+template void decode(const char *, int, Utf32Buffer &, std::vector<int> &);
+
+int byteOffset(const char *bytes, int size, int chars) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(bytes);
+    const unsigned char *end = p + size;
+
+    // In well-formed text every code point has exactly one lead byte, other
+    // than the '\r' of a pair, so the answer is where lead byte number `chars`
+    // is. That '\r' goes with its '\n'.
+    int offset = size;
+    while (end - p >= BLOCK) {
+        std::uint32_t nonAscii, lineFeeds, returns;
+        classifyBlock(p, nonAscii, lineFeeds, returns);
+        std::uint32_t leads = leadBlock(p) & ~pairedReturns(p, end, lineFeeds, returns);
+        int leadCount = popCount(leads);
+        if (leadCount > chars) {
+            for (int i = 0; i < chars; i++) {
+                leads &= leads - 1;
+            }
+            offset = (p - reinterpret_cast<const unsigned char *>(bytes)) + lowestBit(leads);
+            break;
+        }
+        chars -= leadCount;
+        p += BLOCK;
+    }
+    if (offset == size) {
+        for (; p < end; p++) {
+            if ((*p & 0xC0) != 0x80 && !isPairedReturn(p, end) && chars-- == 0) {
+                break;
+            }
+        }
+        offset = p - reinterpret_cast<const unsigned char *>(bytes);
+    }
+    if (offset > 0 && offset < size && isPairedReturn(reinterpret_cast<const unsigned char *>(bytes) + offset - 1, end)) {
+        offset--;
+    }
+    return offset;
+}
+
+int encode(const std::uint32_t *codePoints, int size, char *out) {
+    const std::uint32_t *p = codePoints;
+    const std::uint32_t *end = p + size;
+    unsigned char *write = reinterpret_cast<unsigned char *>(out);
+    unsigned char *writeStart = write;
+
+    while (p < end) {
+        // A block writes BLOCK bytes, which fits in the room reserved for the
+        // BLOCK code points it reads.
+        if (*p < 0x80 && end - p >= BLOCK) {
+            std::uint32_t nonAscii = narrowBlock(p, write);
+            int asciiCount = nonAscii == 0 ? BLOCK : lowestBit(nonAscii);
+            write += asciiCount;
+            p += asciiCount;
+            continue;
+        }
+        write += encodeSequence(*p++, write);
+    }
+    return write - writeStart;
+}
+
+}  // namespace Utf8Codec
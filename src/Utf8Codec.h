@@ -0,0 +1,52 @@
+#ifndef Utf8Codec_H
+#define Utf8Codec_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// UTF-8 conversion used when loading and saving documents. Runs of ASCII are
+// handled 16 (SSE2) or 32 (AVX2) characters at a time, other sequences go
+// through validating scalar code that turns every malformed byte (or invalid
+// code point when encoding) into U+FFFD. Decoding treats '\n' and '\r' as line
+// breaks, like the rest of the editor, and reads a "\r\n" pair as the '\n'
+// alone, so it is a single break.
+namespace Utf8Codec {
+
+typedef std::basic_string<std::uint32_t> Utf32Buffer;
+
+const std::uint32_t REPLACEMENT_CHAR = 0xFFFD;
+const int MAX_BYTES_PER_CHAR = 4;
+
+struct Counts {
+    int chars;
+    int lineFeeds;
+    // Largest code point outside ASCII, or 0 when the bytes are pure ASCII.
+    std::uint32_t maxCodePoint;
+    // Bytes that are not valid UTF-8 and decode to REPLACEMENT_CHAR.
+    int malformed;
+};
+
+// Counts the code points and line breaks `decode` would produce, without
+// writing anything.
+Counts count(const char *bytes, int size);
+
+// Appends the decoded code points to `out` and the positions (relative to the
+// start of `out`) of every line break to `lineBreaks`, in a single pass.
+// `out` may be a Utf32Buffer or a std::vector of 8 or 16 bit units, as long
+// as the units are wide enough for Counts::maxCodePoint of the same bytes.
+template <typename Container>
+void decode(const char *bytes, int size, Container &out, std::vector<int> &lineBreaks);
+
+// Number of bytes taken by the first `chars` code points of `bytes`, which
+// must be well-formed (Counts::malformed == 0). The '\r' left out of a pair
+// is counted with its '\n'.
+int byteOffset(const char *bytes, int size, int chars);
+
+// Writes the UTF-8 form of `size` code points to `out`, which must have room
+// for size * MAX_BYTES_PER_CHAR bytes. Returns the number of bytes written.
+int encode(const std::uint32_t *codePoints, int size, char *out);
+
+}  // namespace Utf8Codec
+
+#endif